@@ -0,0 +1,60 @@
+/*
+ * Times parsing a Patch Text whose only patch is one hex value line of 1, 4 and 10 MiB. The parser walks a value
+ * line once, so the time per MiB should stay about the same as the line grows.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <span>
+#include <sstream>
+#include <string>
+#include "../pchtxt/pchtxt.hpp"
+
+constexpr size_t MIB = 1024 * 1024;
+constexpr int REPEAT_COUNT = 5;
+
+/* A single patch with one line of space separated 8 digit hex words, lineSize bytes long. */
+std::string makePchtxt(size_t lineSize) {
+    std::string pchtxt = "@flag nsobid 0123456789ABCDEF0123456789ABCDEF\n\n// Long Line\n@enabled\n00001000";
+    pchtxt.reserve(pchtxt.size() + lineSize + 1);
+    while (pchtxt.size() < lineSize) pchtxt += " 1F2003D5";
+    pchtxt += '\n';
+    return pchtxt;
+}
+
+/* Best of a few runs, in seconds. */
+template <typename Func>
+double timeBest(Func &&func) {
+    double best = 0;
+    for (int i = 0; i < REPEAT_COUNT; i++) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || seconds < best) best = seconds;
+    }
+    return best;
+}
+
+int main() {
+    std::printf("%10s %12s %12s %14s %14s\n", "line size", "span", "istream", "span/MiB", "istream/MiB");
+    for (size_t mibCount : {1, 4, 10}) {
+        auto pchtxt = makePchtxt(mibCount * MIB);
+        size_t valueSize = 0;
+        auto spanSeconds = timeBest([&] {
+            auto out = pchtxt::parsePchtxt(std::span<const char>(pchtxt));
+            valueSize = out.collections.front().patches.front().contents.front().value.size();
+        });
+        auto istreamSeconds = timeBest([&] {
+            std::istringstream input(pchtxt);
+            pchtxt::parsePchtxt(input);
+        });
+        if (valueSize < mibCount * MIB / 3) {
+            std::fprintf(stderr, "The %zu MiB line was not parsed as one value\n", mibCount);
+            return 1;
+        }
+        std::printf("%6zu MiB %10.1f ms %10.1f ms %11.2f ms %11.2f ms\n", mibCount, spanSeconds * 1000,
+                    istreamSeconds * 1000, spanSeconds * 1000 / mibCount, istreamSeconds * 1000 / mibCount);
+    }
+    return 0;
+}
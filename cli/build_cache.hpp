@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "../pchtxt/hash.hpp"
+
+/* One ips file to write, built from one collection. */
+struct IpsFile {
+    std::string buildId;
+    std::vector<uint8_t> ips;
+    std::string log;
+    uint64_t fingerprint = 0; /* of the collection's source, see pchtxt::fingerprintCollections */
+};
+
+/* Everything converting one pchtxt produces. */
+struct ConversionResult {
+    std::string log;
+    std::vector<IpsFile> ipsFiles;
+};
+
+/* Size and modification time of a file, which tell cheaply whether it may have changed. */
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t modifiedTime = 0;
+
+    bool operator==(const FileStamp &) const = default;
+};
+
+/*
+ * On-disk cache of conversion results, one entry file per input path and key. The key has to cover the tool version
+ * and every option that changes the output. An entry is only used for the same input: an unchanged size and
+ * modification time are trusted right away, otherwise the contents have to hash the same.
+ */
+class BuildCache {
+public:
+    /* What a lookup found, to pass on to store so it does not have to stat and hash the input again. */
+    struct Lookup {
+        FileStamp stamp;
+        uint64_t contentHash = 0;
+        bool isHashed = false;
+        ConversionResult previous; /* on a miss, the result cached for an earlier version of the input */
+    };
+
+    BuildCache(std::filesystem::path dir, std::string key) : m_dir(std::move(dir)), m_key(std::move(key)) {}
+
+    bool createDir() const {
+        std::error_code error;
+        std::filesystem::create_directories(m_dir, error);
+        return !error;
+    }
+
+    static bool getStamp(const std::filesystem::path &path, FileStamp &stamp) {
+        std::error_code error;
+        stamp.size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        auto modifiedTime = std::filesystem::last_write_time(path, error);
+        if (error) return false;
+        stamp.modifiedTime = modifiedTime.time_since_epoch().count();
+        return true;
+    }
+
+    /*
+     * Loads the cached result for inputPath if its stamp still matches. Otherwise calls getContents, and loads the
+     * result if the contents hash the same as when it was cached. Returns false on a miss.
+     */
+    template <typename GetContents>
+    bool load(const std::filesystem::path &inputPath, GetContents getContents, Lookup &lookup,
+              ConversionResult &result) const {
+        if (!getStamp(inputPath, lookup.stamp)) return false;
+
+        Entry entry;
+        bool isLoaded = readEntry(inputPath, entry);
+        if (isLoaded && entry.stamp == lookup.stamp) {
+            result = std::move(entry.result);
+            lookup.contentHash = entry.contentHash;
+            lookup.isHashed = true;
+            return true;
+        }
+
+        std::span<const char> contents = getContents();
+        lookup.contentHash = pchtxt::hashBytes(contents);
+        lookup.isHashed = true;
+        if (!isLoaded) return false;
+        if (entry.contentHash != lookup.contentHash) {
+            lookup.previous = std::move(entry.result);
+            return false;
+        }
+
+        /* same contents under a new stamp: keep the result, and the stamp for next time */
+        result = std::move(entry.result);
+        storeEntry(inputPath, lookup, result);
+        return true;
+    }
+
+    /* Caches result for inputPath. Failing to write the cache is not an error, the next run just misses. */
+    void store(const std::filesystem::path &inputPath, const Lookup &lookup, const ConversionResult &result) const {
+        if (lookup.isHashed) storeEntry(inputPath, lookup, result);
+    }
+
+private:
+    struct Entry {
+        FileStamp stamp;
+        uint64_t contentHash = 0;
+        ConversionResult result;
+    };
+
+    static constexpr std::string_view MAGIC = "PCHTXT2IPS CACHE 2\n";
+
+    std::filesystem::path entryPath(const std::filesystem::path &inputPath) const {
+        auto pathString = std::filesystem::absolute(inputPath).lexically_normal().string();
+        std::ostringstream name;
+        name << std::hex << pchtxt::hashBytes(pathString, pchtxt::hashBytes(m_key)) << ".entry";
+        return m_dir / name.str();
+    }
+
+    static void writeValue(std::ostream &out, uint64_t value) {
+        uint8_t bytes[8];
+        for (int i = 0; i < 8; i++) bytes[i] = uint8_t(value >> (8 * i));
+        out.write(reinterpret_cast<const char *>(bytes), 8);
+    }
+
+    static void writeBytes(std::ostream &out, std::span<const char> bytes) {
+        writeValue(out, bytes.size());
+        out.write(bytes.data(), bytes.size());
+    }
+
+    static bool readValue(std::string_view &in, uint64_t &value) {
+        if (in.size() < 8) return false;
+        value = 0;
+        for (int i = 0; i < 8; i++) value |= uint64_t(uint8_t(in[i])) << (8 * i);
+        in.remove_prefix(8);
+        return true;
+    }
+
+    static bool readBytes(std::string_view &in, std::string_view &bytes) {
+        uint64_t size;
+        if (!readValue(in, size) || in.size() < size) return false;
+        bytes = in.substr(0, size);
+        in.remove_prefix(size);
+        return true;
+    }
+
+    bool readEntry(const std::filesystem::path &inputPath, Entry &entry) const {
+        auto file = std::ifstream(entryPath(inputPath), std::ios::binary);
+        if (!file.is_open()) return false;
+        auto data = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        auto in = std::string_view(data);
+
+        std::string_view key, path, bytes;
+        uint64_t modifiedTime, ipsFileCount;
+        if (!in.starts_with(MAGIC)) return false;
+        in.remove_prefix(MAGIC.size());
+        if (!readBytes(in, key) || key != m_key) return false;
+        if (!readBytes(in, path) || path != std::filesystem::absolute(inputPath).lexically_normal().string()) {
+            return false;
+        }
+        if (!readValue(in, entry.stamp.size) || !readValue(in, modifiedTime) || !readValue(in, entry.contentHash)) {
+            return false;
+        }
+        entry.stamp.modifiedTime = int64_t(modifiedTime);
+
+        if (!readBytes(in, bytes)) return false;
+        entry.result.log = bytes;
+        if (!readValue(in, ipsFileCount) || ipsFileCount > in.size()) return false;
+        entry.result.ipsFiles.resize(ipsFileCount);
+        for (auto &ipsFile : entry.result.ipsFiles) {
+            if (!readBytes(in, bytes)) return false;
+            ipsFile.buildId = bytes;
+            if (!readBytes(in, bytes)) return false;
+            ipsFile.log = bytes;
+            if (!readBytes(in, bytes)) return false;
+            ipsFile.ips.assign(bytes.begin(), bytes.end());
+            if (!readValue(in, ipsFile.fingerprint)) return false;
+        }
+        return in.empty();
+    }
+
+    /* Writes to a temporary file first, so an interrupted run or a concurrent one never leaves half an entry. */
+    void storeEntry(const std::filesystem::path &inputPath, const Lookup &lookup,
+                    const ConversionResult &result) const {
+        auto path = entryPath(inputPath);
+        auto tempPath = path;
+        tempPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        {
+            auto file = std::ofstream(tempPath, std::ios::binary);
+            file.write(MAGIC.data(), MAGIC.size());
+            writeBytes(file, m_key);
+            writeBytes(file, std::filesystem::absolute(inputPath).lexically_normal().string());
+            writeValue(file, lookup.stamp.size);
+            writeValue(file, uint64_t(lookup.stamp.modifiedTime));
+            writeValue(file, lookup.contentHash);
+            writeBytes(file, result.log);
+            writeValue(file, result.ipsFiles.size());
+            for (auto &ipsFile : result.ipsFiles) {
+                writeBytes(file, ipsFile.buildId);
+                writeBytes(file, ipsFile.log);
+                writeBytes(file, {reinterpret_cast<const char *>(ipsFile.ips.data()), ipsFile.ips.size()});
+                writeValue(file, ipsFile.fingerprint);
+            }
+            if (file) file.close();
+            if (!file) {
+                std::error_code error;
+                std::filesystem::remove(tempPath, error);
+                return;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error) std::filesystem::remove(tempPath, error);
+    }
+
+    std::filesystem::path m_dir;
+    std::string m_key;
+};
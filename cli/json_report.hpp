@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#include "../pchtxt/pchtxt.hpp"
+
+/*
+ * Writes the diagnostics of checked pchtxts as one JSON document, a file at a time so a large batch does not have to
+ * be kept in memory:
+ *
+ * {"files": [
+ *   {"path": "a.pchtxt", "diagnostics": [
+ *     {"line": 12, "column": 6, "level": "error", "code": "bad_hex_length", "message": "..."}
+ *   ]}
+ * ]}
+ *
+ * A file that could not be read has an "error" instead of its diagnostics.
+ */
+class JsonReport {
+public:
+    explicit JsonReport(std::ostream &os) : m_os(os) { m_os << "{\"files\": ["; }
+
+    void addFile(std::string_view path, const std::vector<pchtxt::CollectedDiagnostic> &diagnostics) {
+        startFile(path);
+        m_os << ", \"diagnostics\": [";
+        for (size_t i = 0; i < diagnostics.size(); i++) {
+            auto &diagnostic = diagnostics[i];
+            m_os << (i == 0 ? "\n    " : ",\n    ") << "{\"line\": " << diagnostic.lineNum
+                 << ", \"column\": " << diagnostic.column << ", \"level\": ";
+            writeString(pchtxt::getDiagnosticLevelName(diagnostic.level));
+            m_os << ", \"code\": ";
+            writeString(pchtxt::getDiagnosticCodeName(diagnostic.code));
+            m_os << ", \"message\": ";
+            writeString(diagnostic.message);
+            m_os << "}";
+        }
+        m_os << (diagnostics.empty() ? "]}" : "\n  ]}");
+    }
+
+    void addFileError(std::string_view path, std::string_view error) {
+        startFile(path);
+        m_os << ", \"error\": ";
+        writeString(error);
+        m_os << "}";
+    }
+
+    void finish() { m_os << (m_isEmpty ? "]}" : "\n]}") << std::endl; }
+
+private:
+    void startFile(std::string_view path) {
+        m_os << (m_isEmpty ? "\n  " : ",\n  ") << "{\"path\": ";
+        writeString(path);
+        m_isEmpty = false;
+    }
+
+    /* Bytes outside of ASCII are written as they are, pchtxt files being UTF-8. */
+    void writeString(std::string_view str) {
+        m_os << '"';
+        for (char ch : str) {
+            if (ch == '"' || ch == '\\') {
+                m_os << '\\' << ch;
+            } else if (ch == '\n') {
+                m_os << "\\n";
+            } else if (ch == '\r') {
+                m_os << "\\r";
+            } else if (ch == '\t') {
+                m_os << "\\t";
+            } else if (static_cast<unsigned char>(ch) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(ch));
+                m_os << escaped;
+            } else {
+                m_os << ch;
+            }
+        }
+        m_os << '"';
+    }
+
+    std::ostream &m_os;
+    bool m_isEmpty = true;
+};
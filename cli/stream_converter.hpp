@@ -0,0 +1,111 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "../pchtxt/pchtxt.hpp"
+
+/*
+ * Converts a pchtxt while it is parsed, writing the records of each collection to its ips file as soon as they are
+ * read, so memory use stays flat however large the pchtxt is. Files are written as <build id>.ips.part and only
+ * renamed once they are complete. A build id that starts again later in the pchtxt keeps appending to its file.
+ */
+class StreamConverter : public pchtxt::PatchTextHandler {
+public:
+    explicit StreamConverter(std::filesystem::path outputDir) : m_outputDir(std::move(outputDir)) {}
+
+    ~StreamConverter() override { discard(); }
+
+    void onCollectionStart(std::string_view buildId, pchtxt::TargetType) override {
+        auto collection = m_byBuildId.find(std::string(buildId));
+        m_current = collection != m_byBuildId.end() ? collection->second : nullptr;
+        m_currentBuildId = buildId;
+    }
+
+    void onCollectionRename(std::string_view buildId) override {
+        m_currentBuildId = buildId;
+        if (!m_current) return;
+        auto indexed = m_byBuildId.find(m_current->buildId);
+        if (indexed != m_byBuildId.end() && indexed->second == m_current) m_byBuildId.erase(indexed);
+        m_current->buildId = buildId;
+        m_byBuildId.try_emplace(m_current->buildId, m_current);
+    }
+
+    void onPatchStart(const pchtxt::PatchHeader &patchHeader) override {
+        m_isWritingPatch = patchHeader.type == pchtxt::BIN && patchHeader.enabled;
+    }
+
+    /* A collection only gets an ips file once one of its patches has contents, like parsePchtxt only keeps those. */
+    void onContent(uint32_t offset, std::span<const uint8_t> value) override {
+        if (!m_current) startIpsFile();
+        if (m_isWritingPatch) m_current->writer->addContent(offset, value);
+    }
+
+    /* Completes every ips file and renames it into place, logging those that could not be written. */
+    bool finish(std::ostream &logOs) {
+        bool isWritten = true;
+        std::set<std::string> writtenBuildIds;
+        for (auto &ipsFile : m_ipsFiles) {
+            bool isComplete = ipsFile.writer->finish(&logOs);
+            ipsFile.file.close();
+            std::error_code error;
+            if (isComplete && ipsFile.file && writtenBuildIds.insert(ipsFile.buildId).second) {
+                std::filesystem::rename(ipsFile.partPath, m_outputDir / (ipsFile.buildId + ".ips"), error);
+                if (!error) continue;
+            }
+            logOs << "Could not write ips file for " << ipsFile.buildId << '\n';
+            std::filesystem::remove(ipsFile.partPath, error);
+            isWritten = false;
+        }
+        m_ipsFiles.clear();
+        return isWritten;
+    }
+
+    /* Removes the ips files that were not finished, after a parsing error. */
+    void discard() {
+        for (auto &ipsFile : m_ipsFiles) {
+            ipsFile.file.close();
+            std::error_code error;
+            std::filesystem::remove(ipsFile.partPath, error);
+        }
+        m_ipsFiles.clear();
+    }
+
+    bool hasIpsFiles() const { return !m_ipsFiles.empty(); }
+
+private:
+    struct PartialIpsFile {
+        std::string buildId;
+        std::filesystem::path partPath;
+        std::ofstream file;
+        std::unique_ptr<pchtxt::IpsStreamWriter> writer;
+    };
+
+    void startIpsFile() {
+        auto &ipsFile = m_ipsFiles.emplace_back();
+        ipsFile.buildId = m_currentBuildId;
+        /* a legacy build id can rename a collection after its file was started, and another can then take its name */
+        ipsFile.partPath = m_outputDir / (m_currentBuildId + ".ips.part");
+        while (m_partPaths.count(ipsFile.partPath)) ipsFile.partPath += ".part";
+        m_partPaths.insert(ipsFile.partPath);
+        ipsFile.file.open(ipsFile.partPath, std::ios::binary);
+        ipsFile.writer = std::make_unique<pchtxt::IpsStreamWriter>(ipsFile.file);
+        m_current = &ipsFile;
+        m_byBuildId.try_emplace(ipsFile.buildId, m_current);
+    }
+
+    std::filesystem::path m_outputDir;
+    std::list<PartialIpsFile> m_ipsFiles;
+    std::set<std::filesystem::path> m_partPaths;
+    std::unordered_map<std::string, PartialIpsFile *> m_byBuildId;
+    PartialIpsFile *m_current = nullptr;
+    std::string m_currentBuildId;
+    bool m_isWritingPatch = false;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Thread pool where every worker has its own task queue. Tasks submitted from a task go to the queue of the worker
+ * running it, other tasks to a shared queue. A worker runs the newest task of its own queue first, then the oldest
+ * shared task, and otherwise steals the oldest task of another worker, so a long task only ever holds up its own
+ * thread. Threads waiting on a TaskGroup run queued tasks meanwhile, so tasks can wait on tasks of their own.
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threadCount) : m_queues(std::max(threadCount, 1u)) {
+        for (size_t i = 0; i < m_queues.size(); i++) m_threads.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_isStopping = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto &thread : m_threads) thread.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(Task task) {
+        auto &queue = t_pool == this ? m_queues[t_queueIndex] : m_sharedQueue;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queuedCount++;
+            if (&queue == &m_sharedQueue) m_sharedQueuedCount++;
+        }
+        m_wakeUp.notify_all();
+    }
+
+    /*
+     * Runs tasks submitted from tasks on the calling thread until isDone returns true. Shared tasks are left to the
+     * workers, so that a task waiting on others does not pick up unrelated work and wait on that as well.
+     */
+    template <typename IsDone>
+    void runUntil(IsDone isDone) {
+        size_t queueIndex = t_pool == this ? t_queueIndex : NO_QUEUE;
+        while (!isDone()) {
+            if (Task task = takeTask(queueIndex, false)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [&] { return m_queuedCount > m_sharedQueuedCount || isDone(); });
+        }
+    }
+
+    size_t threadCount() const { return m_threads.size(); }
+
+    /* Wakes threads in runUntil to check on their condition. */
+    void notifyAll() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_wakeUp.notify_all();
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static constexpr size_t NO_QUEUE = SIZE_MAX;
+
+    Task takeTask(size_t ownQueueIndex, bool isSharedTaken) {
+        if (ownQueueIndex != NO_QUEUE) {
+            if (Task task = takeTask(m_queues[ownQueueIndex], true)) return task;
+        }
+        if (isSharedTaken) {
+            if (Task task = takeTask(m_sharedQueue, false)) return task;
+        }
+        size_t firstQueueIndex = ownQueueIndex == NO_QUEUE ? 0 : ownQueueIndex + 1;
+        for (size_t i = 0; i < m_queues.size(); i++) {
+            size_t queueIndex = (firstQueueIndex + i) % m_queues.size();
+            if (queueIndex == ownQueueIndex) continue;
+            if (Task task = takeTask(m_queues[queueIndex], false)) return task;
+        }
+        return {};
+    }
+
+    Task takeTask(TaskQueue &queue, bool isNewest) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) return task;
+            if (isNewest) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queuedCount--;
+        if (&queue == &m_sharedQueue) m_sharedQueuedCount--;
+        return task;
+    }
+
+    void workerLoop(size_t queueIndex) {
+        t_pool = this;
+        t_queueIndex = queueIndex;
+        while (true) {
+            if (Task task = takeTask(queueIndex, true)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeUp.wait(lock, [&] { return m_queuedCount > 0 || m_isStopping; });
+            if (m_queuedCount == 0 && m_isStopping) return;
+        }
+    }
+
+    std::vector<TaskQueue> m_queues;
+    TaskQueue m_sharedQueue;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex; /* guards the counts and m_isStopping, and is held to notify so wake ups are not lost */
+    size_t m_queuedCount = 0;
+    size_t m_sharedQueuedCount = 0;
+    bool m_isStopping = false;
+    std::condition_variable m_wakeUp;
+
+    static inline thread_local ThreadPool *t_pool = nullptr;
+    static inline thread_local size_t t_queueIndex = 0;
+};
+
+/* Tasks that can be waited on together. */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool &pool) : m_pool(pool) {}
+
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void run(ThreadPool::Task task) {
+        m_remaining++;
+        /* the group may be gone as soon as m_remaining reaches 0 */
+        m_pool.submit([this, &pool = m_pool, task = std::move(task)] {
+            task();
+            if (--m_remaining == 0) pool.notifyAll();
+        });
+    }
+
+    /* Waits for every task run so far, running queued tasks on this thread meanwhile. */
+    void wait() {
+        m_pool.runUntil([this] { return m_remaining == 0; });
+    }
+
+    bool isDone() const { return m_remaining == 0; }
+
+private:
+    ThreadPool &m_pool;
+    std::atomic<size_t> m_remaining = 0;
+};
@@ -1,34 +1,458 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cli/build_cache.hpp"
+#include "cli/json_report.hpp"
+#include "cli/stream_converter.hpp"
+#include "cli/thread_pool.hpp"
 #include "pchtxt/pchtxt.hpp"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Bump whenever the same pchtxt and options may convert differently, so older cached results are not reused. */
+constexpr const char *VERSION = "1.1.0";
+
+/*
+ * Read-only view of a whole file, memory mapped where the platform allows it. Files that cannot be mapped, such as
+ * pipes and other files that are not regular, are read into memory instead.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const char *path) {
+#ifndef _WIN32
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const char *>(mapping);
+                m_size = st.st_size;
+                m_isMapped = true;
+                m_opened = true;
+            }
+        }
+        if (!m_opened) m_opened = readAll(fd);
+        close(fd);
+#else
+        auto file = std::ifstream(path, std::ios::binary);
+        if (!file.is_open()) return;
+        m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+        m_opened = true;
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (m_isMapped) munmap(const_cast<char *>(m_data), m_size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return m_opened; }
+    std::span<const char> data() const { return {m_data, m_size}; }
+
+private:
+#ifndef _WIN32
+    /* Reads the fd until its end, for files whose size is not known up front. */
+    bool readAll(int fd) {
+        char chunk[64 * 1024];
+        while (true) {
+            ssize_t readSize = read(fd, chunk, sizeof(chunk));
+            if (readSize == 0) break;
+            if (readSize < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            m_buffer.insert(m_buffer.end(), chunk, chunk + readSize);
+        }
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+        return true;
+    }
+
+    bool m_isMapped = false;
+#endif
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_opened = false;
+    std::vector<char> m_buffer;
+};
+
+/* One pchtxt to convert, and everything converting it produced. */
+struct Conversion {
+    std::filesystem::path inputPath;
+    std::filesystem::path outputDir;
+    ConversionResult result;
+    std::string error;
+};
+
+/* Fingerprints of the collections of a pchtxt by build id, leaving out build ids that name several collections. */
+std::unordered_map<std::string, uint64_t> getFingerprints(std::span<const char> pchtxt) {
+    std::unordered_map<std::string, uint64_t> fingerprints;
+    std::unordered_set<std::string> ambiguousBuildIds;
+    for (auto &fingerprint : pchtxt::fingerprintCollections(pchtxt)) {
+        if (!fingerprints.try_emplace(fingerprint.buildId, fingerprint.hash).second) {
+            ambiguousBuildIds.insert(fingerprint.buildId);
+        }
+    }
+    for (auto &buildId : ambiguousBuildIds) fingerprints.erase(buildId);
+    return fingerprints;
+}
+
+/*
+ * Parses the pchtxt and builds its ips files, one task per collection, unless the cache already has them. When only
+ * part of the pchtxt changed, collections whose source did not change reuse their cached ips file.
+ */
+void convert(Conversion &conversion, const pchtxt::IpsOptions &ipsOptions, const BuildCache *cache,
+             ThreadPool &pool) {
+    std::ostringstream log;
+    pchtxt::PatchTextOutput out;
+    BuildCache::Lookup cacheLookup;
+    std::unordered_map<std::string, uint64_t> fingerprints;
+    if (conversion.inputPath == "-") {
+        out = pchtxt::parsePchtxt(std::cin, log);
+    } else {
+        std::unique_ptr<MappedFile> pchtxt;
+        auto mapPchtxt = [&] {
+            if (!pchtxt) pchtxt = std::make_unique<MappedFile>(conversion.inputPath.c_str());
+            return pchtxt->data();
+        };
+        if (cache && cache->load(conversion.inputPath, mapPchtxt, cacheLookup, conversion.result)) return;
+
+        mapPchtxt();
+        if (!pchtxt->isOpen()) {
+            conversion.error = "Could not open file " + conversion.inputPath.string();
+            return;
+        }
+        if (cache) fingerprints = getFingerprints(pchtxt->data());
+        if (pool.threadCount() > 1) {
+            /* large pchtxts are parsed in chunks on the pool as well */
+            auto parallelFor = [&pool](size_t count, const std::function<void(size_t)> &func) {
+                TaskGroup chunkTasks(pool);
+                for (size_t i = 0; i < count; i++) chunkTasks.run([&func, i] { func(i); });
+                chunkTasks.wait();
+            };
+            out = pchtxt::parsePchtxt(pchtxt->data(), log, parallelFor);
+        } else {
+            out = pchtxt::parsePchtxt(pchtxt->data(), log);
+        }
+    }
+    conversion.result.log = log.str();
+    if (out.collections.empty()) {
+        conversion.error = "No patches to write in " + conversion.inputPath.string();
+        return;
+    }
+
+    std::unordered_map<std::string_view, const IpsFile *> previousIpsFiles;
+    for (auto &ipsFile : cacheLookup.previous.ipsFiles) previousIpsFiles.emplace(ipsFile.buildId, &ipsFile);
+
+    auto &ipsFiles = conversion.result.ipsFiles;
+    ipsFiles.resize(out.collections.size());
+    TaskGroup collectionTasks(pool);
+    auto ipsFile = ipsFiles.begin();
+    for (auto &collection : out.collections) {
+        collectionTasks.run([&collection, &ipsFile = *ipsFile, &ipsOptions, &fingerprints, &previousIpsFiles] {
+            ipsFile.buildId = collection.buildId;
+
+            /* reused only if it logged nothing, as its log would have the line numbers from before */
+            auto fingerprint = fingerprints.find(ipsFile.buildId);
+            if (fingerprint != fingerprints.end()) {
+                ipsFile.fingerprint = fingerprint->second;
+                auto previous = previousIpsFiles.find(ipsFile.buildId);
+                if (previous != previousIpsFiles.end() && previous->second->fingerprint == ipsFile.fingerprint &&
+                    previous->second->log.empty() && !previous->second->ips.empty()) {
+                    ipsFile.ips = previous->second->ips;
+                    return;
+                }
+            }
+
+            std::ostringstream log;
+            auto options = ipsOptions;
+            options.logOs = &log;
+            ipsFile.ips = pchtxt::getIps(collection, options);
+            ipsFile.log = log.str();
+        });
+        ++ipsFile;
+    }
+    collectionTasks.wait();
+
+    bool isFailed = std::any_of(ipsFiles.begin(), ipsFiles.end(), [](auto &ipsFile) { return ipsFile.ips.empty(); });
+    if (cache && !isFailed) cache->store(conversion.inputPath, cacheLookup, conversion.result);
+}
+
+/* Writes the file, unless it already has exactly this content, to not touch it for tools that watch for changes. */
+bool writeIfChanged(const std::filesystem::path &path, std::span<const uint8_t> content) {
+    std::error_code error;
+    if (std::filesystem::file_size(path, error) == content.size() && !error) {
+        auto file = std::ifstream(path, std::ios::binary);
+        std::vector<char> existingContent(content.size());
+        if (file.read(existingContent.data(), existingContent.size()) &&
+            std::equal(existingContent.begin(), existingContent.end(), content.begin(),
+                       [](char existing, uint8_t byte) { return uint8_t(existing) == byte; })) {
+            return true;
+        }
+    }
+    auto file = std::ofstream(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(content.data()), content.size());
+    return bool(file);
+}
+
+/* Converts a single pchtxt while reading it, without keeping the pchtxt or its patches in memory. */
+int streamConvert(const std::filesystem::path &inputPath) {
+    StreamConverter converter(std::filesystem::path{});
+    bool isParsed;
+    if (inputPath == "-") {
+        isParsed = pchtxt::parsePchtxt(std::cin, converter, std::cout);
+    } else {
+        auto input = std::ifstream(inputPath, std::ios::binary);
+        if (!input.is_open()) {
+            std::cerr << "Could not open file " << inputPath.string() << std::endl;
+            return 1;
+        }
+        isParsed = pchtxt::parsePchtxt(input, converter, std::cout);
+    }
+    if (!isParsed || !converter.hasIpsFiles()) {
+        converter.discard();
+        std::cerr << "No patches to write in " << inputPath.string() << std::endl;
+        return 1;
+    }
+    return converter.finish(std::cout) ? 0 : 1;
+}
+
+/* One pchtxt to check, and the diagnostics parsing it reported. */
+struct Check {
+    std::filesystem::path inputPath;
+    pchtxt::DiagnosticCollector diagnostics;
+    std::string error;
+};
+
+/* Parses the pchtxt without stopping at errors, collecting every error and warning instead of building ips files. */
+void checkPchtxt(Check &check) {
+    /* each thread keeps its parser, so checking many pchtxts reuses the same buffers */
+    thread_local pchtxt::Parser parser;
+    if (check.inputPath == "-") {
+        parser.parse(std::cin, check.diagnostics);
+        return;
+    }
+    MappedFile pchtxt(check.inputPath.c_str());
+    if (!pchtxt.isOpen()) {
+        check.error = "Could not open file " + check.inputPath.string();
+        return;
+    }
+    parser.parse(pchtxt.data(), check.diagnostics);
+}
+
+/* Checks every pchtxt on the pool and writes a JSON report of their diagnostics, in input order. */
+int checkAll(const std::vector<std::filesystem::path> &inputPaths, unsigned jobCount) {
+    ThreadPool pool(jobCount);
+    std::vector<Check> checks(inputPaths.size());
+    std::vector<std::unique_ptr<TaskGroup>> checkTasks;
+    for (size_t i = 0; i < inputPaths.size(); i++) {
+        checks[i].inputPath = inputPaths[i];
+        checkTasks.push_back(std::make_unique<TaskGroup>(pool));
+        checkTasks.back()->run([&check = checks[i]] { checkPchtxt(check); });
+    }
+
+    int result = 0;
+    JsonReport report(std::cout);
+    for (size_t i = 0; i < checks.size(); i++) {
+        checkTasks[i]->wait();
+        auto &check = checks[i];
+        if (!check.error.empty()) {
+            report.addFileError(check.inputPath.string(), check.error);
+            result = 1;
+        } else {
+            report.addFile(check.inputPath.string(), check.diagnostics.diagnostics());
+            if (check.diagnostics.errorCount() > 0) result = 1;
+        }
+        check = Check();
+    }
+    report.finish();
+    return result;
+}
+
+/* Adds the pchtxt files in a directory and its subdirectories, sorted by path. */
+void addPchtxtFiles(const std::filesystem::path &dir, std::vector<std::filesystem::path> &inputPaths) {
+    std::vector<std::filesystem::path> foundPaths;
+    for (auto &entry : std::filesystem::recursive_directory_iterator(dir)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".pchtxt") foundPaths.push_back(entry.path());
+    }
+    std::sort(foundPaths.begin(), foundPaths.end());
+    inputPaths.insert(inputPaths.end(), foundPaths.begin(), foundPaths.end());
+}
+
 int main(int argc, char **argv) {
     /* Check arguments */
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <pchtxt file>" << std::endl;
+    std::vector<std::string_view> inputArgs;
+    pchtxt::IpsOptions ipsOptions;
+    unsigned jobCount = std::max(std::thread::hardware_concurrency(), 1u);
+    const char *cacheDir = nullptr;
+    bool isStreaming = false;
+    bool isChecking = false;
+    for (int i = 1; i < argc; i++) {
+        auto arg = std::string_view(argv[i]);
+        if (arg == "--optimize") {
+            ipsOptions.optimize = true;
+        } else if (arg == "--stream") {
+            isStreaming = true;
+        } else if (arg == "--check") {
+            isChecking = true;
+        } else if (arg == "--rle" && i + 1 < argc) {
+            ipsOptions.rleMinRunSize = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobCount = std::max(std::strtoul(argv[++i], nullptr, 10), 1ul);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            auto format = std::string_view(argv[++i]);
+            if (format == "ips32") {
+                ipsOptions.format = pchtxt::IPS32;
+            } else if (format == "ips") {
+                ipsOptions.format = pchtxt::IPS;
+            } else if (format == "auto") {
+                ipsOptions.format = pchtxt::IPS_AUTO;
+            } else {
+                std::cerr << "Unknown format " << format << std::endl;
+                return 1;
+            }
+        } else {
+            inputArgs.push_back(arg);
+        }
+    }
+    if (inputArgs.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--optimize] [--rle <min run size>] [--format ips32|ips|auto]"
+                  << " [--jobs <threads>] [--cache <dir>] [--stream] [--check]"
+                  << " <pchtxt file | directory | - for stdin>..." << std::endl;
         return 1;
     }
 
-    /* Open stream. */
-    auto pchtxt = std::fstream(argv[1]);
-    if (!pchtxt.is_open()) {
-        std::cerr << "Could not open file " << argv[1] << std::endl;
-        return 1;
+    /*
+     * A single pchtxt file is converted into the current directory. Otherwise every pchtxt file given, and every one
+     * found in the directories given, is converted next to itself.
+     */
+    std::vector<std::filesystem::path> inputPaths;
+    bool isBatch = inputArgs.size() > 1;
+    for (auto inputArg : inputArgs) {
+        std::error_code error;
+        if (inputArg != "-" && std::filesystem::is_directory(inputArg, error)) {
+            addPchtxtFiles(inputArg, inputPaths);
+            isBatch = true;
+        } else {
+            inputPaths.emplace_back(inputArg);
+        }
+    }
+
+    /* Checking only parses, reporting the diagnostics of every pchtxt as JSON on stdout without writing anything. */
+    if (isChecking) {
+        if (isStreaming) {
+            std::cerr << "--check does not write ips files, so it cannot be used with --stream" << std::endl;
+            return 1;
+        }
+        return checkAll(inputPaths, jobCount);
     }
 
-    /* Parse pchtxt. */
-    auto out = pchtxt::parsePchtxt(pchtxt, std::cout);
+    /* Streaming writes each record as soon as it is read, which only plain IPS32 files allow. */
+    if (isStreaming) {
+        if (ipsOptions.format != pchtxt::IPS32 || ipsOptions.optimize || ipsOptions.rleMinRunSize > 0 || cacheDir) {
+            std::cerr << "--stream only writes ips32 files, without --optimize, --rle or --cache" << std::endl;
+            return 1;
+        }
+        if (isBatch) {
+            std::cerr << "--stream converts a single pchtxt" << std::endl;
+            return 1;
+        }
+        return streamConvert(inputPaths.front());
+    }
+
+    /* Cached results are only reused for the same version and the same options that change the output. */
+    std::unique_ptr<BuildCache> cache;
+    if (cacheDir) {
+        std::ostringstream cacheKey;
+        cacheKey << "pchtxt2ips " << VERSION << " format=" << ipsOptions.format << " optimize=" << ipsOptions.optimize
+                 << " rle=" << ipsOptions.rleMinRunSize;
+        cache = std::make_unique<BuildCache>(cacheDir, cacheKey.str());
+        if (!cache->createDir()) {
+            std::cerr << "Could not create cache directory " << cacheDir << std::endl;
+            return 1;
+        }
+    }
 
-    /* Create ips file. */
-    auto file = std::ofstream(out.collections.front().buildId + ".ips");
+    /* Convert every pchtxt on the pool, each logging on its own so the output stays in order. */
+    ThreadPool pool(jobCount);
+    std::vector<Conversion> conversions(inputPaths.size());
+    std::vector<std::unique_ptr<TaskGroup>> conversionTasks;
+    for (size_t i = 0; i < inputPaths.size(); i++) {
+        conversions[i].inputPath = inputPaths[i];
+        conversions[i].outputDir = isBatch ? inputPaths[i].parent_path() : std::filesystem::path();
+        conversionTasks.push_back(std::make_unique<TaskGroup>(pool));
+        conversionTasks.back()->run([&conversion = conversions[i], &ipsOptions, &cache, &pool] {
+            convert(conversion, ipsOptions, cache.get(), pool);
+        });
+    }
+
+    /* Write the ips files in input order as the conversions finish, so the first to claim a path keeps it. */
+    int result = 0;
+    std::map<std::filesystem::path, size_t> writerOfPath;
+    for (size_t i = 0; i < conversions.size(); i++) {
+        conversionTasks[i]->wait();
+        auto &conversion = conversions[i];
+        if (isBatch) std::cout << conversion.inputPath.string() << ":" << std::endl;
+        std::cout << conversion.result.log;
+        if (!conversion.error.empty()) {
+            std::cerr << conversion.error << std::endl;
+            result = 1;
+        }
 
-    /* Write ips file. */
-    pchtxt::PatchCollection pc {
-        out.collections.front().buildId,
-        out.collections.front().targetType,
-        out.collections.front().patches
-    };
-    pchtxt::writeIps(pc, file);
+        for (auto &ipsFile : conversion.result.ipsFiles) {
+            std::cout << ipsFile.log;
+            auto outputPath = conversion.outputDir / (ipsFile.buildId + ".ips");
+            if (ipsFile.ips.empty()) {
+                std::cerr << "Could not write ips file for " << ipsFile.buildId << std::endl;
+                result = 1;
+                continue;
+            }
+            /* collections with the same build id are merged, so a path claimed twice is usually another pchtxt's */
+            auto [writer, isFirstWriter] = writerOfPath.try_emplace(outputPath, i);
+            if (!isFirstWriter) {
+                std::cerr << "Could not write ips file for " << ipsFile.buildId << ", "
+                          << (writer->second == i ? conversion.inputPath.string() + " has a duplicate build id"
+                                                  : "another pchtxt already wrote " + outputPath.string())
+                          << std::endl;
+                result = 1;
+                continue;
+            }
+            if (!writeIfChanged(outputPath, ipsFile.ips)) {
+                std::cerr << "Could not write ips file " << outputPath.string() << std::endl;
+                result = 1;
+            }
+        }
+        conversion = Conversion();
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return result;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file arena.hpp
+ * @brief Memory resource for memory that is all freed at once
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+namespace pchtxt {
+
+/**
+ * A memory resource that hands out memory from large blocks, and only frees it all at once on reset. Unlike
+ * std::pmr::monotonic_buffer_resource, reset keeps the blocks, so once they cover the most memory used between two
+ * resets, allocating from the arena no longer allocates from upstream at all
+ */
+class Arena : public std::pmr::memory_resource {
+   public:
+    explicit Arena(size_t firstBlockSize = 64 * 1024,
+                   std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : m_nextBlockSize(firstBlockSize), m_upstream(upstream) {}
+
+    ~Arena() override {
+        for (auto& block : m_blocks) m_upstream->deallocate(block.data, block.size, alignof(std::max_align_t));
+    }
+
+    Arena(const Arena&) = delete;
+    auto operator=(const Arena&) -> Arena& = delete;
+
+    /**
+     * Make all of the memory available again. Everything allocated before is invalid afterwards
+     */
+    void reset() {
+        m_curBlock = 0;
+        m_curPos = 0;
+    }
+
+    /**
+     * Total size of the blocks, which is how much memory the arena holds
+     */
+    auto capacity() const {
+        auto result = size_t{0};
+        for (auto& block : m_blocks) result += block.size;
+        return result;
+    }
+
+   private:
+    struct Block {
+        std::byte* data;
+        size_t size;
+    };
+
+    auto do_allocate(size_t bytes, size_t alignment) -> void* override {
+        while (true) {
+            if (m_curBlock == m_blocks.size()) addBlock(bytes + alignment);
+
+            // alignment is always a power of 2
+            auto& block = m_blocks[m_curBlock];
+            auto blockAddress = reinterpret_cast<uintptr_t>(block.data);
+            auto pos = ((blockAddress + m_curPos + alignment - 1) & ~(alignment - 1)) - blockAddress;
+            if (pos + bytes <= block.size) {
+                m_curPos = pos + bytes;
+                return block.data + pos;
+            }
+
+            // the rest of the block is left unused
+            m_curBlock++;
+            m_curPos = 0;
+        }
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override { return this == &other; }
+
+    void addBlock(size_t minSize) {
+        auto size = std::max(m_nextBlockSize, minSize);
+        m_blocks.push_back({static_cast<std::byte*>(m_upstream->allocate(size, alignof(std::max_align_t))), size});
+        m_nextBlockSize = size * 2;
+    }
+
+    std::vector<Block> m_blocks;
+    size_t m_curBlock = 0;
+    size_t m_curPos = 0;  // in the current block
+    size_t m_nextBlockSize;
+    std::pmr::memory_resource* m_upstream;
+};
+
+}  // namespace pchtxt
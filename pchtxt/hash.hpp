@@ -0,0 +1,59 @@
+/**
+ * @file hash.hpp
+ * @brief Fast hashing to tell whether Patch Text sources changed
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+namespace pchtxt {
+
+/**
+ * Non-cryptographic 64-bit hash (MurmurHash64A), reading 8 bytes at a time
+ * @param bytes the bytes to hash
+ * @param seed [optional] a previous hash, to hash several pieces as one
+ * @return The hash of the bytes
+ */
+inline auto hashBytes(std::span<const char> bytes, uint64_t seed = 0) -> uint64_t {
+    constexpr auto MULTIPLIER = uint64_t{0xC6A4A7935BD1E995};
+    constexpr auto SHIFT = 47;
+
+    auto hash = seed ^ (bytes.size() * MULTIPLIER);
+    auto blockEnd = bytes.size() / 8 * 8;
+    for (auto i = size_t{0}; i < blockEnd; i += 8) {
+        auto block = uint64_t{};
+        std::memcpy(&block, bytes.data() + i, 8);
+        block *= MULTIPLIER;
+        block ^= block >> SHIFT;
+        block *= MULTIPLIER;
+        hash ^= block;
+        hash *= MULTIPLIER;
+    }
+    if (blockEnd < bytes.size()) {
+        for (auto i = bytes.size(); i-- > blockEnd;) {
+            hash ^= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (8 * (i - blockEnd));
+        }
+        hash *= MULTIPLIER;
+    }
+    hash ^= hash >> SHIFT;
+    hash *= MULTIPLIER;
+    hash ^= hash >> SHIFT;
+    return hash;
+}
+
+}  // namespace pchtxt
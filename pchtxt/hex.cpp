@@ -0,0 +1,200 @@
+/**
+ * @file hex.cpp
+ * @brief Hex value decoding for the Patch Text parser
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hex.hpp"
+
+#include <array>
+
+#if (defined(__x86_64__) or defined(__i386__)) and defined(__GNUC__)
+#define PCHTXT_HEX_X86 1
+#include <immintrin.h>
+#endif
+
+namespace pchtxt {
+
+constexpr auto INVALID_NIBBLE = uint8_t{0xFF};
+
+constexpr auto HEX_NIBBLES = [] {
+    auto table = std::array<uint8_t, 256>{};
+    table.fill(INVALID_NIBBLE);
+    for (auto ch = '0'; ch <= '9'; ch++) table[static_cast<uint8_t>(ch)] = ch - '0';
+    for (auto ch = 'a'; ch <= 'f'; ch++) {
+        table[static_cast<uint8_t>(ch)] = ch - 'a' + 10;
+        table[static_cast<uint8_t>(ch - 'a' + 'A')] = ch - 'a' + 10;
+    }
+    return table;
+}();
+
+// decodes the bytes [firstByte, byteCount) of the token, writing them to their final position in out
+inline auto decodeHexScalar(std::string_view token, uint8_t* out, bool isBigEndian, size_t firstByte) -> size_t {
+    auto byteCount = token.size() / 2;
+    for (auto i = firstByte; i < byteCount; i++) {
+        auto high = HEX_NIBBLES[static_cast<uint8_t>(token[i * 2])];
+        auto low = HEX_NIBBLES[static_cast<uint8_t>(token[i * 2 + 1])];
+        if ((high | low) > 0x0F) {
+            return high == INVALID_NIBBLE ? i * 2 : i * 2 + 1;
+        }
+        out[isBigEndian ? byteCount - 1 - i : i] = (high << 4) | low;
+    }
+    return std::string_view::npos;
+}
+
+inline auto decodeHexGeneric(std::string_view token, uint8_t* out, bool isBigEndian) -> size_t {
+    return decodeHexScalar(token, out, isBigEndian, 0);
+}
+
+#ifdef PCHTXT_HEX_X86
+
+// Both kernels map every character to a nibble and a validity mask:
+//   digits:  ch - '0' in [0, 9]
+//   letters: (ch | 0x20) - 'a' in [0, 5], plus 10
+// then fold each pair of nibbles into a byte with maddubs (high * 16 + low) and pack the words down to bytes.
+
+__attribute__((target("sse4.1"))) inline auto decodeHexSse41(std::string_view token, uint8_t* out,
+                                                             bool isBigEndian) -> size_t {
+    constexpr auto CHARS_PER_BLOCK = size_t{16};
+    auto byteCount = token.size() / 2;
+    auto blockCount = token.size() / CHARS_PER_BLOCK;
+
+    const auto zeroChar = _mm_set1_epi8('0');
+    const auto lowerA = _mm_set1_epi8('a');
+    const auto caseBit = _mm_set1_epi8(0x20);
+    const auto nine = _mm_set1_epi8(9);
+    const auto five = _mm_set1_epi8(5);
+    const auto ten = _mm_set1_epi8(10);
+    const auto pairWeights = _mm_set1_epi16(0x0110);
+    const auto reverseBytes = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    for (auto block = size_t{0}; block < blockCount; block++) {
+        auto chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(token.data() + block * CHARS_PER_BLOCK));
+
+        auto digits = _mm_sub_epi8(chars, zeroChar);
+        auto letters = _mm_sub_epi8(_mm_or_si128(chars, caseBit), lowerA);
+        auto isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, nine), digits);
+        auto isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letters, five), letters);
+
+        auto validMask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)));
+        if (validMask != 0xFFFF) return block * CHARS_PER_BLOCK + __builtin_ctz(~validMask);
+
+        auto nibbles = _mm_blendv_epi8(_mm_add_epi8(letters, ten), digits, isDigit);
+        auto bytes = _mm_packus_epi16(_mm_maddubs_epi16(nibbles, pairWeights), _mm_setzero_si128());
+
+        if (isBigEndian) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + byteCount - (block + 1) * 8),
+                             _mm_shuffle_epi8(bytes, reverseBytes));
+        } else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + block * 8), bytes);
+        }
+    }
+
+    return decodeHexScalar(token, out, isBigEndian, blockCount * CHARS_PER_BLOCK / 2);
+}
+
+__attribute__((target("avx2"))) inline auto decodeHexAvx2(std::string_view token, uint8_t* out,
+                                                           bool isBigEndian) -> size_t {
+    constexpr auto CHARS_PER_BLOCK = size_t{32};
+    auto byteCount = token.size() / 2;
+    auto blockCount = token.size() / CHARS_PER_BLOCK;
+
+    const auto zeroChar = _mm256_set1_epi8('0');
+    const auto lowerA = _mm256_set1_epi8('a');
+    const auto caseBit = _mm256_set1_epi8(0x20);
+    const auto nine = _mm256_set1_epi8(9);
+    const auto five = _mm256_set1_epi8(5);
+    const auto ten = _mm256_set1_epi8(10);
+    const auto pairWeights = _mm256_set1_epi16(0x0110);
+    const auto reverseBytes = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    for (auto block = size_t{0}; block < blockCount; block++) {
+        auto chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(token.data() + block * CHARS_PER_BLOCK));
+
+        auto digits = _mm256_sub_epi8(chars, zeroChar);
+        auto letters = _mm256_sub_epi8(_mm256_or_si256(chars, caseBit), lowerA);
+        auto isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, nine), digits);
+        auto isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letters, five), letters);
+
+        auto validMask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)));
+        if (validMask != 0xFFFFFFFF) return block * CHARS_PER_BLOCK + __builtin_ctz(~validMask);
+
+        auto nibbles = _mm256_blendv_epi8(_mm256_add_epi8(letters, ten), digits, isDigit);
+        auto words = _mm256_maddubs_epi16(nibbles, pairWeights);
+        // packus works per 128 bit lane, gather the low quadword of both lanes
+        auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0b1000);
+        auto bytes = _mm256_castsi256_si128(packed);
+
+        if (isBigEndian) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + byteCount - (block + 1) * 16),
+                             _mm_shuffle_epi8(bytes, reverseBytes));
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + block * 16), bytes);
+        }
+    }
+
+    return decodeHexScalar(token, out, isBigEndian, blockCount * CHARS_PER_BLOCK / 2);
+}
+
+#endif
+
+using DecodeHexFunc = auto (*)(std::string_view, uint8_t*, bool) -> size_t;
+
+auto isHexKernelSupported(HexKernel kernel) -> bool {
+    switch (kernel) {
+        case HexKernel::SCALAR:
+            return true;
+#ifdef PCHTXT_HEX_X86
+        case HexKernel::SSE41:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1");
+        case HexKernel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+inline auto getDecodeHex(HexKernel kernel) -> DecodeHexFunc {
+    switch (kernel) {
+#ifdef PCHTXT_HEX_X86
+        case HexKernel::SSE41:
+            return decodeHexSse41;
+        case HexKernel::AVX2:
+            return decodeHexAvx2;
+#endif
+        default:
+            return decodeHexGeneric;
+    }
+}
+
+inline auto selectDecodeHex() -> DecodeHexFunc {
+    for (auto kernel : {HexKernel::AVX2, HexKernel::SSE41}) {
+        if (isHexKernelSupported(kernel)) return getDecodeHex(kernel);
+    }
+    return decodeHexGeneric;
+}
+
+auto decodeHex(std::string_view token, uint8_t* out, bool isBigEndian) -> size_t {
+    static const auto decodeHexImpl = selectDecodeHex();
+    return decodeHexImpl(token, out, isBigEndian);
+}
+
+auto decodeHex(HexKernel kernel, std::string_view token, uint8_t* out, bool isBigEndian) -> size_t {
+    return getDecodeHex(kernel)(token, out, isBigEndian);
+}
+
+}  // namespace pchtxt
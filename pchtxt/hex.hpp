@@ -0,0 +1,52 @@
+/**
+ * @file hex.hpp
+ * @brief Hex value decoding for the Patch Text parser
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace pchtxt {
+
+/**
+ * Validate and decode a whole token of hex digits in one pass. Uses AVX2 or SSE4.1 when the CPU supports it
+ * @param token the hex digits, of even length. The last character of an odd length token is not read
+ * @param out where to write the token.size() / 2 decoded bytes
+ * @param isBigEndian write the bytes in reverse order
+ * @return Position of the first character in token that is not a hex digit, or std::string_view::npos. The content
+ * of out is unspecified if the token is not valid
+ */
+auto decodeHex(std::string_view token, uint8_t* out, bool isBigEndian) -> size_t;
+
+/**
+ * The implementations decodeHex chooses from, by what the CPU supports
+ */
+enum class HexKernel { SCALAR, SSE41, AVX2 };
+
+/**
+ * Check if the CPU can run a kernel of decodeHex. SCALAR runs everywhere
+ */
+auto isHexKernelSupported(HexKernel kernel) -> bool;
+
+/**
+ * decodeHex with a given kernel, to test the kernels against each other
+ * @param kernel a kernel isHexKernelSupported returns true for
+ */
+auto decodeHex(HexKernel kernel, std::string_view token, uint8_t* out, bool isBigEndian) -> size_t;
+
+}  // namespace pchtxt
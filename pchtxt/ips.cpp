@@ -0,0 +1,554 @@
+/**
+ * @file ips.cpp
+ * @brief IPS output for patch collections
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pchtxt.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+namespace pchtxt {
+
+// CONSTANTS
+
+constexpr auto IPS_RECORD_SIZE_SIZE = size_t{2};  // after the offset
+constexpr auto IPS_RUN_SIZE = size_t{3};          // 2 byte run size, 1 byte value, after a record size of 0
+constexpr auto IPS_MAX_RECORD_SIZE = uint32_t{0xFFFF};
+
+struct IpsFormatInfo {
+    const char* headerMagic;
+    const char* footerMagic;
+    int offsetSize;
+    uint32_t maxOffset;
+    uint32_t footerOffset;  // a record at this offset would be read as the footer
+};
+
+constexpr auto IPS_FORMAT_INFO = IpsFormatInfo{"PATCH", "EOF", 3, 0xFFFFFF, 0x454F46};
+constexpr auto IPS32_FORMAT_INFO = IpsFormatInfo{"IPS32", "EEOF", 4, 0xFFFFFFFF, 0x45454F46};
+
+// IPS output is made of the contents of enabled BIN patches
+
+template <typename ContentFunc>
+void forEachIpsContent(const PatchCollection& patchCollection, ContentFunc&& contentFunc) {
+    for (auto& patch : patchCollection.patches) {
+        if (patch.type != BIN or patch.enabled == false) continue;
+        for (auto& patchContent : patch.contents) {
+            contentFunc(patch, patchContent.offset, std::span<const uint8_t>{patchContent.value});
+        }
+    }
+}
+
+// utils
+
+inline auto writeMagic(uint8_t* out, const char* magic) -> uint8_t* {
+    auto magicSize = std::strlen(magic);
+    std::memcpy(out, magic, magicSize);
+    return out + magicSize;
+}
+
+// writes the lowest byteCount bytes of value, most significant first
+inline auto writeBigEndian(uint8_t* out, uint32_t value, int byteCount) -> uint8_t* {
+    for (auto rightShift = byteCount - 1; rightShift >= 0; rightShift--) {
+        *out++ = static_cast<uint8_t>((value >> rightShift * 8) & 0xFF);
+    }
+    return out;
+}
+
+// a record at one of these offsets cannot be written in that format. Runs never start or end there, so that the
+// literal records next to them can always be moved off them
+inline auto isFooterOffset(uint64_t offset) -> bool {
+    return offset == IPS_FORMAT_INFO.footerOffset or offset == IPS32_FORMAT_INFO.footerOffset;
+}
+
+// not utils
+
+// the records of one IPS file, planned before anything is written so the file can be sized exactly. Record data is
+// never copied, records point into the values of the collection, which must outlive the plan
+class IpsPlan {
+   public:
+    IpsPlan(const PatchCollection& patchCollection, const IpsOptions& options) {
+        if (options.optimize) {
+            planOptimized(patchCollection, options);
+        } else {
+            auto addContent = [&](const Patch& patch, uint32_t offset, std::span<const uint8_t> value) {
+                if (isAddressable(patch, offset, value, options.logOs)) addRecord(offset, value);
+            };
+            forEachIpsContent(patchCollection, addContent);
+        }
+        if (not m_isValid) return;
+        if (options.rleMinRunSize > 0) encodeRuns(options.rleMinRunSize);
+        m_isValid = selectFormat(options.format, options.logOs);
+    }
+
+    // false if the records cannot be written in the requested format
+    auto isValid() const -> bool { return m_isValid; }
+
+    auto size() const -> size_t { return sizeAs(*m_format); }
+
+    // out must hold size() bytes
+    auto write(uint8_t* out) const -> uint8_t* {
+        out = writeMagic(out, m_format->headerMagic);
+        auto piece = m_pieces.begin();
+        for (auto& record : m_records) {
+            out = writeBigEndian(out, record.offset, m_format->offsetSize);
+            if (record.isRun) {
+                out = writeBigEndian(out, 0, IPS_RECORD_SIZE_SIZE);
+                out = writeBigEndian(out, record.size, 2);
+                *out++ = record.runByte;
+                continue;
+            }
+            out = writeBigEndian(out, record.size, IPS_RECORD_SIZE_SIZE);
+            for (; piece != m_pieces.begin() + record.piecesEnd; ++piece) {
+                if (piece->empty()) continue;
+                std::memcpy(out, piece->data(), piece->size());
+                out += piece->size();
+            }
+        }
+        return writeMagic(out, m_format->footerMagic);
+    }
+
+   private:
+    struct Record {
+        uint32_t offset;
+        size_t size;
+        size_t piecesEnd;     // index past the last piece of the record, which starts where the previous record ended
+        bool isRun = false;   // size copies of runByte, without pieces
+        uint8_t runByte = 0;
+    };
+
+    struct OrderedContent {
+        uint32_t offset;
+        std::span<const uint8_t> value;
+        std::string_view patchName;
+        int lineNum;
+        size_t order;  // position in the Patch Text, later contents overwrite earlier ones
+
+        auto end() const -> uint64_t { return uint64_t{offset} + value.size(); }
+    };
+
+    // a value that runs past the last offset IPS32 can address would wrap around to the start of the binary, which
+    // makes the whole file invalid
+    auto isAddressable(const Patch& patch, uint32_t offset, std::span<const uint8_t> value, std::ostream* logOs)
+        -> bool {
+        if (uint64_t{offset} + value.size() <= uint64_t{IPS32_FORMAT_INFO.maxOffset} + 1) return true;
+        if (logOs != nullptr) {
+            *logOs << "ERROR: " << patch.name << " (L" << patch.lineNum << ") writes " << value.size()
+                   << " bytes at offset " << std::hex << std::setfill('0') << std::setw(8) << offset
+                   << ", past the last offset " << IPS32_FORMAT_INFO.maxOffset << std::dec << '\n';
+        }
+        m_isValid = false;
+        return false;
+    }
+
+    // values over the size limit are written as consecutive records, each pointing into the value
+    void addRecord(uint32_t offset, std::span<const uint8_t> value) {
+        while (not value.empty()) {  // a record of size 0 would be read as a run
+            auto piece = value.first(std::min<size_t>(value.size(), IPS_MAX_RECORD_SIZE));
+            m_pieces.push_back(piece);
+            m_records.push_back({offset, piece.size(), m_pieces.size()});
+            m_valueSize += piece.size();
+            offset += piece.size();
+            value = value.subspan(piece.size());
+        }
+    }
+
+    // continues the last record if the value starts where it ends, and splits records at the size limit
+    void appendToRecords(uint32_t offset, std::span<const uint8_t> value) {
+        while (not value.empty()) {
+            if (m_records.empty() or m_records.back().isRun or m_records.back().size == IPS_MAX_RECORD_SIZE or
+                uint64_t{m_records.back().offset} + m_records.back().size != offset) {
+                m_records.push_back({offset, 0, m_pieces.size()});
+            }
+            auto& record = m_records.back();
+            auto piece = value.first(std::min<size_t>(value.size(), IPS_MAX_RECORD_SIZE - record.size));
+            m_pieces.push_back(piece);
+            record.size += piece.size();
+            record.piecesEnd = m_pieces.size();
+            m_valueSize += piece.size();
+            offset += piece.size();
+            value = value.subspan(piece.size());
+        }
+    }
+
+    void planOptimized(const PatchCollection& patchCollection, const IpsOptions& options) {
+        auto contents = std::vector<OrderedContent>{};
+        forEachIpsContent(patchCollection, [&](const Patch& patch, uint32_t offset, std::span<const uint8_t> value) {
+            if (value.empty() or not isAddressable(patch, offset, value, options.logOs)) return;
+            contents.push_back({offset, value, patch.name, patch.lineNum, contents.size()});
+        });
+        if (not m_isValid) return;
+        std::sort(contents.begin(), contents.end(), [](auto& lhs, auto& rhs) {
+            return std::tie(lhs.offset, lhs.order) < std::tie(rhs.offset, rhs.order);
+        });
+
+        if (options.logOs != nullptr) reportOverlaps(contents, *options.logOs);
+
+        // sweep over the offsets. Of the contents covering an offset, the one that comes last in the Patch Text is
+        // written there, so the contents covering the current offset are kept in a heap by order
+        auto coveringContents = std::vector<const OrderedContent*>{};
+        auto isEarlier = [](auto* lhs, auto* rhs) { return lhs->order < rhs->order; };
+        auto nextContent = contents.begin();
+        auto curOffset = uint64_t{0};
+
+        while (nextContent != contents.end() or not coveringContents.empty()) {
+            if (coveringContents.empty()) curOffset = nextContent->offset;
+            for (; nextContent != contents.end() and nextContent->offset == curOffset; ++nextContent) {
+                coveringContents.push_back(&*nextContent);
+                std::push_heap(coveringContents.begin(), coveringContents.end(), isEarlier);
+            }
+            while (not coveringContents.empty() and coveringContents.front()->end() <= curOffset) {
+                std::pop_heap(coveringContents.begin(), coveringContents.end(), isEarlier);
+                coveringContents.pop_back();
+            }
+            if (coveringContents.empty()) continue;
+
+            // written until it ends or a content that may come later starts
+            auto* lastContent = coveringContents.front();
+            auto segmentEnd = lastContent->end();
+            if (nextContent != contents.end()) segmentEnd = std::min<uint64_t>(segmentEnd, nextContent->offset);
+            appendToRecords(static_cast<uint32_t>(curOffset),
+                            lastContent->value.subspan(curOffset - lastContent->offset, segmentEnd - curOffset));
+            curOffset = segmentEnd;
+        }
+    }
+
+    // reports each content that overlaps one before it by offset, along with the one reaching the furthest into it
+    static void reportOverlaps(const std::vector<OrderedContent>& sortedContents, std::ostream& logOs) {
+        auto* furthestContent = static_cast<const OrderedContent*>(nullptr);
+        for (auto& content : sortedContents) {
+            if (furthestContent != nullptr and furthestContent->end() > content.offset) {
+                auto isLater = content.order > furthestContent->order;
+                auto& writer = isLater ? content : *furthestContent;
+                auto& overwritten = isLater ? *furthestContent : content;
+                logOs << "L" << writer.lineNum << ": " << writer.patchName << " overwrites "
+                      << std::min(content.end(), furthestContent->end()) - content.offset << " bytes of "
+                      << overwritten.patchName << " (L" << overwritten.lineNum << ") at offset " << std::hex
+                      << std::setfill('0') << std::setw(8) << content.offset << std::dec << '\n';
+            }
+            if (furthestContent == nullptr or content.end() > furthestContent->end()) furthestContent = &content;
+        }
+    }
+
+    void addRun(uint32_t offset, size_t runSize, uint8_t runByte) {
+        while (runSize > 0) {
+            auto recordSize = std::min<size_t>(runSize, IPS_MAX_RECORD_SIZE);
+            if (isFooterOffset(uint64_t{offset} + recordSize)) recordSize--;
+            m_records.push_back({offset, recordSize, m_pieces.size(), true, runByte});
+            m_runCount++;
+            offset += recordSize;
+            runSize -= recordSize;
+        }
+    }
+
+    // moves the runs of repeated bytes that are at least minRunSize long out of the literal records, into run records,
+    // wherever that makes the file smaller
+    void encodeRuns(size_t minRunSize) {
+        auto literalRecords = std::exchange(m_records, {});
+        auto literalPieces = std::exchange(m_pieces, {});
+        m_valueSize = 0;
+
+        auto piecesBegin = size_t{0};
+        for (auto& literalRecord : literalRecords) {
+            auto pieces = std::span{literalPieces}.subspan(piecesBegin, literalRecord.piecesEnd - piecesBegin);
+            piecesBegin = literalRecord.piecesEnd;
+
+            // adds the literal bytes [begin, end) of the record, pieces are walked forward only
+            auto curPiece = pieces.begin();
+            auto curPieceStart = size_t{0};
+            auto addLiteral = [&](size_t begin, size_t end) {
+                if (begin == end) return;
+                while (curPieceStart + curPiece->size() <= begin) curPieceStart += (curPiece++)->size();
+                m_records.push_back({static_cast<uint32_t>(literalRecord.offset + begin), end - begin, 0});
+                while (begin < end) {
+                    auto pieceEnd = std::min(curPieceStart + curPiece->size(), end);
+                    m_pieces.push_back(curPiece->subspan(begin - curPieceStart, pieceEnd - begin));
+                    begin = pieceEnd;
+                    if (begin == curPieceStart + curPiece->size()) curPieceStart += (curPiece++)->size();
+                }
+                m_records.back().piecesEnd = m_pieces.size();
+                m_valueSize += m_records.back().size;
+            };
+
+            auto literalStart = size_t{0};
+            auto runStart = size_t{0};
+            auto runByte = uint8_t{0};
+            // a run record replaces its bytes with 3, and every literal left beside it needs its own header. Headers
+            // are counted at their IPS32 size, the larger one, as the format is only picked afterwards
+            auto recordHeaderSize = IPS32_FORMAT_INFO.offsetSize + IPS_RECORD_SIZE_SIZE;
+            auto takeRun = [&](size_t runEnd) {
+                auto runSize = runEnd - runStart;
+                auto runOffset = uint64_t{literalRecord.offset} + runStart;
+                if (isFooterOffset(runOffset) or isFooterOffset(runOffset + runSize)) return;
+                auto headerCost =
+                    IPS_RUN_SIZE + recordHeaderSize * ((runStart > literalStart) + (runEnd < literalRecord.size));
+                if (runSize < minRunSize or runSize <= headerCost) return;
+                addLiteral(literalStart, runStart);
+                addRun(static_cast<uint32_t>(literalRecord.offset + runStart), runSize, runByte);
+                literalStart = runEnd;
+            };
+
+            auto recordPos = size_t{0};
+            for (auto piece : pieces) {
+                for (auto byte : piece) {
+                    if (recordPos == 0 or byte != runByte) {
+                        if (recordPos > 0) takeRun(recordPos);
+                        runStart = recordPos;
+                        runByte = byte;
+                    }
+                    recordPos++;
+                }
+            }
+            takeRun(literalRecord.size);
+            addLiteral(literalStart, literalRecord.size);
+        }
+    }
+
+    auto sizeAs(const IpsFormatInfo& format) const -> size_t {
+        return std::strlen(format.headerMagic) + m_records.size() * (format.offsetSize + IPS_RECORD_SIZE_SIZE) +
+               m_runCount * IPS_RUN_SIZE + m_valueSize + std::strlen(format.footerMagic);
+    }
+
+    auto selectFormat(IpsFormat format, std::ostream* logOs) -> bool {
+        auto fitsIps = std::all_of(m_records.begin(), m_records.end(),
+                                   [](auto& record) { return record.offset <= IPS_FORMAT_INFO.maxOffset; });
+
+        if (format == IPS32) {
+            m_format = &IPS32_FORMAT_INFO;
+            return moveRecordsOffFooter(logOs);
+        }
+
+        if (format == IPS) {
+            m_format = &IPS_FORMAT_INFO;
+            if (not fitsIps) {
+                if (logOs != nullptr) {
+                    *logOs << "ERROR: offsets past " << std::hex << IPS_FORMAT_INFO.maxOffset << std::dec
+                           << " do not fit in IPS, use IPS32\n";
+                }
+                return false;
+            }
+            return moveRecordsOffFooter(logOs);
+        }
+
+        // IPS_AUTO: IPS records are a byte shorter, so IPS is smaller unless moving records off its footer offset
+        // added some. No record can be at the IPS32 footer offset if all of them fit IPS
+        m_format = &IPS32_FORMAT_INFO;
+        if (not fitsIps) return moveRecordsOffFooter(logOs);
+        auto ips32Size = sizeAs(IPS32_FORMAT_INFO);
+
+        auto isAtIpsFooter = [](auto& record) { return record.offset == IPS_FORMAT_INFO.footerOffset; };
+        if (std::none_of(m_records.begin(), m_records.end(), isAtIpsFooter)) {
+            m_format = &IPS_FORMAT_INFO;
+            return true;
+        }
+        auto ips32Records = m_records;
+        auto ips32Pieces = m_pieces;
+        m_format = &IPS_FORMAT_INFO;
+        if (moveRecordsOffFooter(nullptr) and size() < ips32Size) return true;
+        m_records = std::move(ips32Records);
+        m_pieces = std::move(ips32Pieces);
+        m_format = &IPS32_FORMAT_INFO;
+        return true;
+    }
+
+    // splits a piece in two at pos, keeping both in the same records
+    void splitPiece(size_t pieceIndex, size_t pos) {
+        auto piece = m_pieces[pieceIndex];
+        m_pieces[pieceIndex] = piece.first(pos);
+        m_pieces.insert(m_pieces.begin() + pieceIndex + 1, piece.subspan(pos));
+        for (auto& record : m_records) {
+            if (record.piecesEnd > pieceIndex) record.piecesEnd++;
+        }
+    }
+
+    // a record at the footer offset of the format is started a byte early instead, taking over the last byte of the
+    // record that ends there. Runs never start or end at a footer offset, see encodeRuns
+    auto moveRecordsOffFooter(std::ostream* logOs) -> bool {
+        for (auto recordIndex = size_t{0}; recordIndex < m_records.size(); recordIndex++) {
+            if (m_records[recordIndex].offset != m_format->footerOffset) continue;
+
+            auto* prevRecord = recordIndex > 0 ? &m_records[recordIndex - 1] : nullptr;
+            if (m_records[recordIndex].isRun or prevRecord == nullptr or prevRecord->isRun or
+                uint64_t{prevRecord->offset} + prevRecord->size != m_format->footerOffset) {
+                if (logOs != nullptr) {
+                    *logOs << "ERROR: cannot write a record at offset " << std::hex << m_format->footerOffset
+                           << std::dec << ", which reads as the IPS footer" << '\n';
+                }
+                return false;
+            }
+
+            // the last piece of the previous record becomes the first piece of this one
+            auto lastPieceIndex = prevRecord->piecesEnd - 1;
+            if (m_pieces[lastPieceIndex].size() > 1) {
+                splitPiece(lastPieceIndex, m_pieces[lastPieceIndex].size() - 1);
+                lastPieceIndex++;
+            }
+            m_records[recordIndex - 1].piecesEnd = lastPieceIndex;
+            m_records[recordIndex - 1].size--;
+            m_records[recordIndex].offset--;
+            m_records[recordIndex].size++;
+            if (m_records[recordIndex - 1].size == 0) {
+                m_records.erase(m_records.begin() + recordIndex - 1);
+                recordIndex--;
+            }
+
+            // the last byte of the record goes to a record of its own if it no longer fits
+            auto& record = m_records[recordIndex];
+            if (record.size > IPS_MAX_RECORD_SIZE) {
+                auto overflowPieceIndex = record.piecesEnd - 1;
+                if (m_pieces[overflowPieceIndex].size() > 1) {
+                    splitPiece(overflowPieceIndex, m_pieces[overflowPieceIndex].size() - 1);
+                    overflowPieceIndex++;
+                }
+                auto overflowRecord = Record{record.offset + IPS_MAX_RECORD_SIZE, 1, record.piecesEnd};
+                record.size--;
+                record.piecesEnd = overflowPieceIndex;
+                m_records.insert(m_records.begin() + recordIndex + 1, overflowRecord);
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::span<const uint8_t>> m_pieces;
+    std::vector<Record> m_records;
+    size_t m_valueSize = 0;
+    size_t m_runCount = 0;
+    const IpsFormatInfo* m_format = &IPS32_FORMAT_INFO;
+    bool m_isValid = true;
+};
+
+auto getIpsSize(const PatchCollection& patchCollection, const IpsOptions& options) -> size_t {
+    auto ipsPlan = IpsPlan(patchCollection, options);
+    return ipsPlan.isValid() ? ipsPlan.size() : 0;
+}
+
+auto writeIps(const PatchCollection& patchCollection, std::span<uint8_t> buffer, const IpsOptions& options)
+    -> size_t {
+    auto ipsPlan = IpsPlan(patchCollection, options);
+    if (not ipsPlan.isValid()) return 0;
+    auto ipsSize = ipsPlan.size();
+    if (buffer.size() < ipsSize) return 0;
+    ipsPlan.write(buffer.data());
+    return ipsSize;
+}
+
+auto getIps(const PatchCollection& patchCollection, const IpsOptions& options) -> std::vector<uint8_t> {
+    auto ipsPlan = IpsPlan(patchCollection, options);
+    if (not ipsPlan.isValid()) return {};
+    auto ips = std::vector<uint8_t>(ipsPlan.size());
+    ipsPlan.write(ips.data());
+    return ips;
+}
+
+void writeIps(const PatchCollection& patchCollection, std::ostream& ostream, const IpsOptions& options) {
+    auto ips = getIps(patchCollection, options);
+    ostream.write(reinterpret_cast<const char*>(ips.data()), ips.size());
+}
+
+IpsStreamWriter::IpsStreamWriter(std::ostream& ostream) : m_ostream(ostream) {
+    m_ostream.write(IPS32_FORMAT_INFO.headerMagic, std::strlen(IPS32_FORMAT_INFO.headerMagic));
+}
+
+// records are split the same way as IpsPlan::addRecord does, after the same check as IpsPlan::isAddressable
+void IpsStreamWriter::addContent(uint32_t offset, std::span<const uint8_t> value) {
+    if (m_problem != Problem::NONE) return;
+    if (uint64_t{offset} + value.size() > uint64_t{IPS32_FORMAT_INFO.maxOffset} + 1) {
+        m_problem = Problem::PAST_LAST_OFFSET;
+        m_problemOffset = offset;
+        m_problemSize = value.size();
+        return;
+    }
+    while (not value.empty()) {
+        auto piece = value.first(std::min<size_t>(value.size(), IPS_MAX_RECORD_SIZE));
+        addRecord(offset, piece);
+        offset += piece.size();
+        value = value.subspan(piece.size());
+    }
+}
+
+auto IpsStreamWriter::finish(std::ostream* logOs) -> bool {
+    if (m_problem == Problem::RECORD_AT_FOOTER) {
+        if (logOs != nullptr) {
+            *logOs << "ERROR: cannot write a record at offset " << std::hex << IPS32_FORMAT_INFO.footerOffset
+                   << std::dec << ", which reads as the IPS footer" << '\n';
+        }
+        return false;
+    }
+    if (m_problem == Problem::PAST_LAST_OFFSET) {
+        if (logOs != nullptr) {
+            *logOs << "ERROR: " << m_problemSize << " bytes at offset " << std::hex << std::setfill('0')
+                   << std::setw(8) << m_problemOffset << " run past the last offset " << IPS32_FORMAT_INFO.maxOffset
+                   << std::dec << '\n';
+        }
+        return false;
+    }
+    writeHeldRecord();
+    m_ostream.write(IPS32_FORMAT_INFO.footerMagic, std::strlen(IPS32_FORMAT_INFO.footerMagic));
+    return true;
+}
+
+// a record at the footer offset is started a byte early instead, the same way as IpsPlan::moveRecordsOffFooter does.
+// Only a record that ends at the footer offset may have to give its last byte to the next one, so only that one is
+// held back, every other record is written right away from the caller's value
+void IpsStreamWriter::addRecord(uint32_t offset, std::span<const uint8_t> value) {
+    if (offset != IPS32_FORMAT_INFO.footerOffset) {
+        writeHeldRecord();
+        if (uint64_t{offset} + value.size() == IPS32_FORMAT_INFO.footerOffset) {
+            m_heldOffset = offset;
+            m_heldRecord.assign(value.begin(), value.end());
+        } else {
+            writeRecord(offset, value, {});
+        }
+        return;
+    }
+
+    if (m_heldRecord.empty()) {
+        m_problem = Problem::RECORD_AT_FOOTER;
+        return;
+    }
+    auto movedByte = m_heldRecord.back();
+    m_heldRecord.pop_back();
+    writeHeldRecord();
+
+    // the last byte of the record goes to a record of its own if it no longer fits
+    auto recordValue = value.first(std::min<size_t>(value.size(), IPS_MAX_RECORD_SIZE - 1));
+    writeRecord(offset - 1, {&movedByte, 1}, recordValue);
+    if (recordValue.size() < value.size()) {
+        writeRecord(offset - 1 + IPS_MAX_RECORD_SIZE, value.subspan(recordValue.size()), {});
+    }
+}
+
+void IpsStreamWriter::writeHeldRecord() {
+    if (m_heldRecord.empty()) return;
+    writeRecord(m_heldOffset, m_heldRecord, {});
+    m_heldRecord.clear();
+}
+
+// the record's value is head followed by tail
+void IpsStreamWriter::writeRecord(uint32_t offset, std::span<const uint8_t> head, std::span<const uint8_t> tail) {
+    uint8_t header[IPS32_FORMAT_INFO.offsetSize + IPS_RECORD_SIZE_SIZE];
+    writeBigEndian(writeBigEndian(header, offset, IPS32_FORMAT_INFO.offsetSize), head.size() + tail.size(),
+                   IPS_RECORD_SIZE_SIZE);
+    m_ostream.write(reinterpret_cast<const char*>(header), sizeof(header));
+    m_ostream.write(reinterpret_cast<const char*>(head.data()), head.size());
+    m_ostream.write(reinterpret_cast<const char*>(tail.data()), tail.size());
+}
+
+}  // namespace pchtxt
@@ -20,12 +20,17 @@
 
 #include "pchtxt.hpp"
 
+#include "arena.hpp"
+#include "hash.hpp"
+#include "hex.hpp"
+
 #include <algorithm>
-#include <cstring>
+#include <array>
 #include <iomanip>
-#include <set>
-#include <unordered_map>
+#include <span>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 
 namespace pchtxt {
 
@@ -37,12 +42,12 @@ constexpr auto AUTHOR_IDENTIFIER_OPEN = "[";
 constexpr auto AUTHOR_IDENTIFIER_CLOSE = "]";
 constexpr auto AMS_CHEAT_IDENTIFIER_OPEN = "[";
 constexpr auto AMS_CHEAT_IDENTIFIER_CLOSE = "]";
+constexpr auto TAG_IDENTIFIER = "@";
 // meta tags
 constexpr auto TITLE_TAG = "@title";
 constexpr auto PROGRAM_ID_TAG = "@program";
 constexpr auto URL_TAG = "@url";
 constexpr auto NSOBID_TAG = "@nsobid";  // legacy
-const auto META_TAGS = std::set<std::string_view>{TITLE_TAG, PROGRAM_ID_TAG, URL_TAG, NSOBID_TAG};
 // parsing tags
 constexpr auto ENABLED_TAG = "@enabled";
 constexpr auto DISABLED_TAG = "@disabled";
@@ -60,450 +65,888 @@ constexpr auto NROBID_FLAG = "nrobid";
 constexpr auto OFFSET_SHIFT_FLAG = "offset_shift";
 constexpr auto DEBUG_INFO_FLAG = "debug_info";
 constexpr auto ALT_DEBUG_INFO_FLAG = "print_values";  // legacy
+// parallel parsing
+constexpr auto MIN_PARALLEL_CHUNK_SIZE = size_t{256} * 1024;  // smaller chunks do not pay for their task
+
+// lexer tables
+
+enum CharClass : uint8_t { CHAR_SPACE = 1 << 0, CHAR_HEX = 1 << 1 };
+
+// same classes as std::isspace/std::isxdigit in the "C" locale, without the locale lookup
+constexpr auto CHAR_CLASSES = [] {
+    auto table = std::array<uint8_t, 256>{};
+    for (auto ch : {' ', '\t', '\n', '\v', '\f', '\r'}) table[static_cast<uint8_t>(ch)] |= CHAR_SPACE;
+    for (auto ch = '0'; ch <= '9'; ch++) table[static_cast<uint8_t>(ch)] |= CHAR_HEX;
+    for (auto ch = 'a'; ch <= 'f'; ch++) {
+        table[static_cast<uint8_t>(ch)] |= CHAR_HEX;
+        table[static_cast<uint8_t>(ch - 'a' + 'A')] |= CHAR_HEX;
+    }
+    return table;
+}();
+
+enum class LineKind : uint8_t { EMPTY, TAG, ECHO, AMS_CHEAT, COMMENT, CONTENT };
+
+// a line's kind is decided by its first character
+constexpr auto LINE_KINDS = [] {
+    auto table = std::array<LineKind, 256>{};
+    table.fill(LineKind::CONTENT);
+    table[static_cast<uint8_t>(TAG_IDENTIFIER[0])] = LineKind::TAG;
+    table[static_cast<uint8_t>(ECHO_IDENTIFIER[0])] = LineKind::ECHO;
+    table[static_cast<uint8_t>(AMS_CHEAT_IDENTIFIER_OPEN[0])] = LineKind::AMS_CHEAT;
+    table[static_cast<uint8_t>(COMMENT_IDENTIFIER[0])] = LineKind::COMMENT;
+    return table;
+}();
 
-// IPS
-constexpr auto IPS32_HEADER_MAGIC = "IPS32";
-constexpr auto IPS32_FOOTER_MAGIC = "EEOF";
+enum class Tag : uint8_t { UNKNOWN, TITLE, PROGRAM_ID, URL, NSOBID, ENABLED, DISABLED, STOP_PARSING, FLAG };
+
+constexpr std::pair<std::string_view, Tag> TAGS[] = {
+    {TITLE_TAG, Tag::TITLE},       {PROGRAM_ID_TAG, Tag::PROGRAM_ID}, {URL_TAG, Tag::URL},
+    {NSOBID_TAG, Tag::NSOBID},     {ENABLED_TAG, Tag::ENABLED},       {DISABLED_TAG, Tag::DISABLED},
+    {STOP_PARSING_TAG, Tag::STOP_PARSING}, {FLAG_TAG, Tag::FLAG}};
+
+enum class Flag : uint8_t { UNKNOWN, BIG_ENDIAN_ORDER, LITTLE_ENDIAN_ORDER, NSOBID, NROBID, OFFSET_SHIFT, DEBUG_INFO };
+
+constexpr std::pair<std::string_view, Flag> FLAGS[] = {
+    {BIG_ENDIAN_FLAG, Flag::BIG_ENDIAN_ORDER}, {LITTLE_ENDIAN_FLAG, Flag::LITTLE_ENDIAN_ORDER},
+    {NSOBID_FLAG, Flag::NSOBID},               {NROBID_FLAG, Flag::NROBID},
+    {OFFSET_SHIFT_FLAG, Flag::OFFSET_SHIFT},   {DEBUG_INFO_FLAG, Flag::DEBUG_INFO},
+    {ALT_DEBUG_INFO_FLAG, Flag::DEBUG_INFO}};
 
 // utils
 
-inline auto isStartsWith(std::string& checkedStr, std::string_view targetStr) {
-    return checkedStr.size() >= targetStr.size() and checkedStr.substr(0, targetStr.size()) == targetStr;
+inline auto isSpace(char ch) -> bool { return CHAR_CLASSES[static_cast<uint8_t>(ch)] & CHAR_SPACE; }
+
+inline auto isHex(char ch) -> bool { return CHAR_CLASSES[static_cast<uint8_t>(ch)] & CHAR_HEX; }
+
+inline auto toLower(char ch) -> char { return ch >= 'A' and ch <= 'Z' ? ch - 'A' + 'a' : ch; }
+
+// compares against an all lower case target
+inline auto isEqualIgnoreCase(std::string_view checkedStr, std::string_view lowerTargetStr) {
+    return checkedStr.size() == lowerTargetStr.size() and
+           std::equal(begin(checkedStr), end(checkedStr), begin(lowerTargetStr),
+                      [](char ch, char targetCh) { return toLower(ch) == targetCh; });
 }
 
-inline void ltrim(std::string& str) {
-    str.erase(begin(str), std::find_if(begin(str), end(str), [](char ch) { return not std::isspace(ch); }));
+inline auto isStartsWithIgnoreCase(std::string_view checkedStr, std::string_view lowerTargetStr) {
+    return checkedStr.size() >= lowerTargetStr.size() and
+           isEqualIgnoreCase(checkedStr.substr(0, lowerTargetStr.size()), lowerTargetStr);
 }
 
-inline void rtrim(std::string& str) {
-    str.erase(std::find_if(rbegin(str), rend(str), [](char ch) { return !std::isspace(ch); }).base(), end(str));
+template <typename T, size_t N>
+inline auto lookup(const std::pair<std::string_view, T> (&table)[N], std::string_view key) -> T {
+    for (auto& [name, value] : table) {
+        if (isEqualIgnoreCase(key, name)) return value;
+    }
+    return T{};
 }
 
-inline void trim(std::string& str) {
-    ltrim(str);
-    rtrim(str);
+inline auto ltrim(std::string_view str) {
+    auto pos = size_t{0};
+    while (pos < str.size() and isSpace(str[pos])) pos++;
+    return str.substr(pos);
 }
 
-inline auto firstToken(std::string& str) {
-    return std::string(begin(str), std::find_if(begin(str), end(str), [](char ch) { return std::isspace(ch); }));
+inline auto rtrim(std::string_view str) {
+    auto size = str.size();
+    while (size > 0 and isSpace(str[size - 1])) size--;
+    return str.substr(0, size);
 }
 
-inline auto commentPos(std::string& str) {
-    auto pos = 0;
-    auto isInString = false;
-    for (auto ch : str) {
-        if (ch == COMMENT_IDENTIFIER[0] and not isInString) {
-            break;
-        }
-        if (ch == '"') {
-            isInString = !isInString;
-        }
-        pos++;
-    }
-    return pos;
+inline auto trim(std::string_view str) { return rtrim(ltrim(str)); }
+
+inline auto firstToken(std::string_view str) {
+    auto size = size_t{0};
+    while (size < str.size() and not isSpace(str[size])) size++;
+    return str.substr(0, size);
 }
 
-inline auto getLineCommentContent(std::string& str) {
-    auto commentContentStart = std::find_if(begin(str) + commentPos(str), end(str), [](char ch) {
-        return not(std::isspace(ch) or ch == COMMENT_IDENTIFIER[0]);
-    });
-    auto result = std::string(commentContentStart, end(str));
-    return result;
+inline auto stringIsHex(std::string_view str) { return std::all_of(begin(str), end(str), isHex); }
+
+inline auto trimZeros(std::string_view str) {
+    if (str.empty()) return str;
+    return str.substr(std::min(str.find_first_not_of('0'), str.size() - 1));
 }
 
-inline auto getLineNoComment(std::string& lineStr) {
-    auto result = lineStr.substr(0, commentPos(lineStr));
-    rtrim(result);
-    return result;
+// streams a string_view lower cased, for logging values the way they were matched
+struct LowerCase {
+    std::string_view str;
+};
+
+inline auto operator<<(std::ostream& os, LowerCase lowerCase) -> std::ostream& {
+    for (auto ch : lowerCase.str) os.put(toLower(ch));
+    return os;
 }
 
-inline auto getStringToLowerCase(std::string& str) {
-    auto result = std::string(str);
-    std::transform(begin(result), end(result), begin(result), [](char ch) { return std::tolower(ch); });
-    return result;
+/**
+ * One line of a Patch Text, classified in a single scan. All views point into the line buffer
+ */
+struct Line {
+    LineKind kind;
+    std::string_view text;       /*!< The trimmed line */
+    std::string_view noComment;  /*!< The trimmed line without its comment */
+    std::string_view comment;    /*!< The comment content, without the comment identifiers */
+};
+
+inline auto lexLine(std::string_view rawLine) -> Line {
+    auto text = trim(rawLine);
+    if (text.empty()) return {LineKind::EMPTY, text, text, text};
+
+    // comment identifiers inside of strings do not count
+    auto commentPos = size_t{0};
+    auto isInString = false;
+    for (; commentPos < text.size(); commentPos++) {
+        auto ch = text[commentPos];
+        if (ch == COMMENT_IDENTIFIER[0] and not isInString) break;
+        if (ch == '"') isInString = not isInString;
+    }
+
+    auto commentContentPos = commentPos;
+    while (commentContentPos < text.size() and
+           (isSpace(text[commentContentPos]) or text[commentContentPos] == COMMENT_IDENTIFIER[0])) {
+        commentContentPos++;
+    }
+
+    return {LINE_KINDS[static_cast<uint8_t>(text[0])], text, rtrim(text.substr(0, commentPos)),
+            text.substr(commentContentPos)};
 }
 
-inline auto stringIsHex(std::string& str) {
-    return std::find_if(begin(str), end(str), [](char ch) { return not std::isxdigit(ch); }) == end(str);
+inline auto getHexCharNibble(char ch) -> uint8_t {
+    if (ch >= 'A' and ch <= 'F') return ch - 'A' + 10;
+    if (ch >= 'a' and ch <= 'f') return ch - 'a' + 10;
+    return ch - '0';  // this is okay because we already check the string is hex
 }
 
-inline void trimZeros(std::string& str) { str.erase(0, std::min(str.find_first_not_of('0'), str.size() - 1)); }
+// str must be hex and at most 8 digits long
+inline auto getHexUInt32(std::string_view str) {
+    auto result = uint32_t{0};
+    for (auto ch : str) result = (result << 4) | getHexCharNibble(ch);
+    return result;
+}
 
-inline void escapeString(std::string& str) {
-    auto escapingPos = begin(str);
-    auto targetPos = begin(str);
+// parsed the way std::stoi does with base 0, which takes decimal, hex with 0x and octal with 0
+inline auto parseOffsetShift(std::string_view str, int& offsetShift) -> bool {
+    try {
+        offsetShift = std::stoi(std::string{str}, nullptr, 0);
+        return true;
+    } catch (const std::logic_error&) {  // not a number, or out of range
+        return false;
+    }
+}
 
-    while (escapingPos != end(str)) {
+// values are matched lower cased, so string patches are taken lower cased as well before escaping
+inline void appendEscapedString(std::string_view str, std::vector<uint8_t>& value) {
+    for (auto escapingPos = begin(str); escapingPos != end(str); escapingPos++) {
         if (*escapingPos == '\\' and escapingPos + 1 != end(str)) {
             escapingPos++;
 
-            switch (*escapingPos) {
+            switch (auto ch = toLower(*escapingPos)) {
                 case 'a':
-                    *targetPos = '\a';
+                    value.push_back('\a');
                     break;
                 case 'b':
-                    *targetPos = '\b';
+                    value.push_back('\b');
                     break;
                 case 'f':
-                    *targetPos = '\f';
+                    value.push_back('\f');
                     break;
                 case 'n':
-                    *targetPos = '\n';
+                    value.push_back('\n');
                     break;
                 case 'r':
-                    *targetPos = '\r';
+                    value.push_back('\r');
                     break;
                 case 't':
-                    *targetPos = '\t';
+                    value.push_back('\t');
                     break;
                 case 'v':
-                    *targetPos = '\v';
+                    value.push_back('\v');
                     break;
                 default:
-                    *targetPos = *escapingPos;
+                    value.push_back(ch);
             }
         } else {
-            *targetPos = *escapingPos;
+            value.push_back(toLower(*escapingPos));
         }
-        escapingPos++;
-        targetPos++;
     }
-
-    if (targetPos != end(str)) str.erase(targetPos, end(str));
 }
 
-inline auto getHexCharNibble(char ch) -> uint8_t {
-    if (ch >= 'A' and ch <= 'F') return ch - 'A' + 10;
-    if (ch >= 'a' and ch <= 'f') return ch - 'a' + 10;
-    return ch - '0';  // this is okay because we already check the string is hex
-}
+// line readers, each yields lines as views that stay valid until the next line is read
 
-inline auto getHexByte(std::string::iterator& strIter) -> uint8_t {
-    return (getHexCharNibble(*strIter) << 4) + getHexCharNibble(*(strIter + 1));
-}
+class IstreamLineReader {
+   public:
+    IstreamLineReader(std::istream& input, std::string& lineBuffer) : m_input(input), m_lineBuffer(lineBuffer) {}
+
+    auto next(std::string_view& line) -> bool {
+        if (not std::getline(m_input, m_lineBuffer)) return false;
+        line = m_lineBuffer;
+        return true;
+    }
+
+   private:
+    std::istream& m_input;
+    std::string& m_lineBuffer;
+};
+
+// splits lines the same way std::getline does, pointing straight into the input
+class SpanLineReader {
+   public:
+    explicit SpanLineReader(std::span<const char> input) : m_input(input.data(), input.size()) {}
+
+    auto next(std::string_view& line) -> bool {
+        if (m_pos >= m_input.size()) return false;
+        auto lineEnd = m_input.find('\n', m_pos);
+        if (lineEnd == std::string_view::npos) lineEnd = m_input.size();
+        line = m_input.substr(m_pos, lineEnd - m_pos);
+        m_pos = lineEnd + 1;
+        return true;
+    }
+
+   private:
+    std::string_view m_input;
+    size_t m_pos = 0;
+};
 
 // not utils
 
-auto parsePchtxt(std::istream& input) -> PatchTextOutput {
-    auto throwAwaySs = std::stringstream{};
-    return parsePchtxt(input, throwAwaySs);
+// collects the meta data from the head of a Patch Text, which ends at the first empty line
+class MetaParser {
+   public:
+    // legacyTitle is a buffer to reuse
+    MetaParser(PatchTextMeta& meta, std::string& legacyTitle) : m_meta(meta), m_legacyTitle(legacyTitle) {
+        m_legacyTitle.clear();
+    }
+
+    auto isDone() const { return m_isDone; }
+
+    template <typename Sink>
+    void parseLine(const Line& line, int curLineNum, Sink& sink) {
+        // meta should stop at an empty line
+        if (line.kind == LineKind::EMPTY) {
+            sink.report({.level = LEVEL_INFO, .code = DiagnosticCode::META_DONE, .lineNum = curLineNum});
+            finish(curLineNum, sink);
+            return;
+        }
+
+        auto lineNoComment = line.noComment;
+
+        if (line.kind == LineKind::TAG and not lineNoComment.empty()) {
+            auto curTag = firstToken(lineNoComment);
+            auto tag = lookup(TAGS, curTag);
+            if (tag == Tag::STOP_PARSING) {
+                sink.report({.level = LEVEL_INFO, .code = DiagnosticCode::META_STOPPED, .lineNum = curLineNum});
+                finish(curLineNum, sink);
+                return;
+            }
+
+            auto* curTagTarget = tag == Tag::TITLE        ? &m_meta.title
+                                 : tag == Tag::PROGRAM_ID ? &m_meta.programId
+                                 : tag == Tag::URL        ? &m_meta.url
+                                                          : nullptr;
+            auto code = tag == Tag::TITLE        ? DiagnosticCode::META_TITLE
+                        : tag == Tag::PROGRAM_ID ? DiagnosticCode::META_PROGRAM_ID
+                                                 : DiagnosticCode::META_URL;
+            if (curTagTarget) {
+                auto curTagValue = ltrim(lineNoComment.substr(curTag.size()));
+                // strip quatation marks if necessary
+                if (not curTagValue.empty() and curTagValue.front() == '"' and curTagValue.back() == '"') {
+                    curTagValue = curTagValue.substr(1, curTagValue.size() - 2);
+                }
+                *curTagTarget = curTagValue;
+                sink.report({.level = LEVEL_INFO, .code = code, .lineNum = curLineNum, .subject = curTagValue});
+            }
+        } else if (line.kind == LineKind::ECHO and not lineNoComment.empty()) {  // echo identifier
+            m_legacyTitle = ltrim(lineNoComment.substr(1));
+        }
+    }
+
+    template <typename Sink>
+    void finish(int curLineNum, Sink& sink) {
+        m_isDone = true;
+        if (m_meta.title.empty()) {
+            m_meta.title = m_legacyTitle;
+            sink.report({.level = LEVEL_INFO,
+                         .code = DiagnosticCode::LEGACY_TITLE,
+                         .lineNum = curLineNum,
+                         .subject = m_legacyTitle});
+        }
+    }
+
+   private:
+    PatchTextMeta& m_meta;
+    std::string& m_legacyTitle;
+    bool m_isDone = false;
+};
+
+template <typename LineReader, typename Sink>
+auto readPchtxtMeta(LineReader& reader, Sink& sink) -> PatchTextMeta {
+    auto result = PatchTextMeta{};
+    auto legacyTitle = std::string{};
+    auto metaParser = MetaParser{result, legacyTitle};
+
+    auto curLineNum = 1;
+    auto rawLine = std::string_view{};
+    while (not metaParser.isDone()) {
+        if (not reader.next(rawLine)) {
+            sink.report({.level = LEVEL_INFO, .code = DiagnosticCode::META_END_OF_FILE, .lineNum = curLineNum});
+            metaParser.finish(curLineNum, sink);
+            break;
+        }
+        auto line = lexLine(rawLine);
+        if (line.kind == LineKind::ECHO) {
+            sink.report({.level = LEVEL_INFO,
+                         .code = DiagnosticCode::ECHO,
+                         .lineNum = curLineNum,
+                         .subject = line.noComment});
+        }
+        metaParser.parseLine(line, curLineNum, sink);
+
+        curLineNum++;
+    }
+
+    return result;
 }
 
-auto parsePchtxt(std::istream& input, std::ostream& logOs) -> PatchTextOutput {
-    auto result = PatchTextOutput{};
+// what the parser keeps of a collection, to check for a build id and to log the same way whatever the handler keeps
+struct CollectionState {
+    using allocator_type = Allocator;
 
-    // parse meta
-    auto curPos = input.tellg();
-    result.meta = getPchtxtMeta(input, logOs);
-    input.seekg(curPos);
+    std::pmr::string buildId;
+    TargetType targetType = NSO;
+    bool hasPatches = false;
+
+    CollectionState() = default;
+    explicit CollectionState(const allocator_type& alloc) : buildId(alloc) {}
+    CollectionState(const CollectionState& other, const allocator_type& alloc)
+        : buildId(other.buildId, alloc), targetType(other.targetType), hasPatches(other.hasPatches) {}
+    CollectionState(CollectionState&& other, const allocator_type& alloc)
+        : buildId(std::move(other.buildId), alloc), targetType(other.targetType), hasPatches(other.hasPatches) {}
+};
+
+inline auto hasPatches(const PatchCollection& patchCollection) { return not patchCollection.patches.empty(); }
+
+inline auto hasPatches(const CollectionState& collectionState) { return collectionState.hasPatches; }
+
+// moves the patches of from to the end of into, which share the memory resource of their collection list
+inline void mergePatches(PatchCollection& into, PatchCollection& from) {
+    into.patches.splice(end(into.patches), from.patches);
+}
+
+inline void mergePatches(CollectionState& into, const CollectionState& from) { into.hasPatches |= from.hasPatches; }
+
+// keeps every collection in place in a list, indexed by build id. The current collection, which patches are added
+// to, is always the last one in the list
+template <typename CollectionList>
+class CollectionIndex {
+   public:
+    using Collection = typename CollectionList::value_type;
+
+    // the index is allocated from the same memory resource as the collections
+    explicit CollectionIndex(CollectionList& collections)
+        : m_collections(collections), m_current(end(collections)), m_byBuildId(collections.get_allocator()) {}
+
+    // nullptr before the first build id
+    auto current() -> Collection* { return m_current != end(m_collections) ? &*m_current : nullptr; }
+
+    // switch to the collection for buildId, creating it if it has not been seen yet
+    auto select(std::string_view buildId, TargetType targetType) -> Collection& {
+        dropCurrentIfEmpty();
+
+        auto existingCollection = m_byBuildId.find(buildId);
+        if (existingCollection != end(m_byBuildId)) {  // bid already exist
+            m_current = existingCollection->second;
+            m_collections.splice(end(m_collections), m_collections, m_current);
+        } else {
+            m_current = m_collections.emplace(end(m_collections));
+            m_current->buildId = buildId;
+            m_current->targetType = targetType;
+            m_byBuildId.emplace(m_current->buildId, m_current);
+        }
+        return *m_current;
+    }
+
+    // legacy style bid, which names the current collection. A bid that was already seen gets the current collection's
+    // patches appended, as if it had been selected before them
+    auto rename(std::string_view buildId) -> Collection& {
+        if (m_current == end(m_collections)) {
+            m_current = m_collections.emplace(end(m_collections));
+        } else {
+            unindex(m_current);
+        }
+
+        auto existingCollection = m_byBuildId.find(buildId);
+        if (existingCollection != end(m_byBuildId)) {  // bid already exist
+            auto renamed = m_current;
+            m_current = existingCollection->second;
+            mergePatches(*m_current, *renamed);
+            m_collections.erase(renamed);
+            m_collections.splice(end(m_collections), m_collections, m_current);
+        } else {
+            m_current->buildId = buildId;
+            m_current->targetType = NSO;
+            m_byBuildId.emplace(m_current->buildId, m_current);
+        }
+        return *m_current;
+    }
+
+    // collections are only kept if they have patches
+    void dropCurrentIfEmpty() {
+        if (m_current == end(m_collections) or hasPatches(*m_current)) return;
+        unindex(m_current);
+        m_collections.erase(m_current);
+        m_current = end(m_collections);
+    }
+
+   private:
+    using CollectionIter = typename CollectionList::iterator;
+
+    void unindex(CollectionIter collection) {
+        auto indexed = m_byBuildId.find(collection->buildId);
+        if (indexed != end(m_byBuildId) and indexed->second == collection) m_byBuildId.erase(indexed);
+    }
+
+    CollectionList& m_collections;
+    CollectionIter m_current;
+    std::pmr::unordered_map<std::string_view, CollectionIter> m_byBuildId;  // keys point into the collections' buildId
+};
+
+// builds the patches of a Patch Text, the derived class decides where they go
+class PatchBuilder : public PatchTextHandler {
+   public:
+    explicit PatchBuilder(const Allocator& allocator) : m_curPatch(allocator) {}
+
+    void onPatchStart(const PatchHeader& patchHeader) override {
+        m_curPatch = Patch{m_curPatch.get_allocator()};
+        m_curPatch.name = patchHeader.name;
+        m_curPatch.author = patchHeader.author;
+        m_curPatch.type = patchHeader.type;
+        m_curPatch.enabled = patchHeader.enabled;
+        m_curPatch.lineNum = patchHeader.lineNum;
+    }
+
+    void onContent(uint32_t offset, std::span<const uint8_t> value) override {
+        auto& patchContent = m_curPatch.contents.emplace_back();
+        patchContent.offset = offset;
+        patchContent.value.assign(begin(value), end(value));
+    }
+
+   protected:
+    Patch m_curPatch;
+};
+
+// builds the PatchTextOutput that parsePchtxt returns
+class PatchTextBuilder : public PatchBuilder {
+   public:
+    explicit PatchTextBuilder(std::pmr::memory_resource* memoryResource)
+        : PatchBuilder(Allocator{memoryResource}),
+          m_result(Allocator{memoryResource}),
+          m_collectionIndex(m_result.collections) {}
+
+    void onMeta(const PatchTextMeta& meta) override { m_result.meta = meta; }
+
+    void onCollectionStart(std::string_view buildId, TargetType targetType) override {
+        m_collectionIndex.select(buildId, targetType);
+    }
+
+    void onCollectionRename(std::string_view buildId) override { m_collectionIndex.rename(buildId); }
+
+    void onPatchEnd() override {
+        if (not m_curPatch.contents.empty()) m_collectionIndex.current()->patches.push_back(std::move(m_curPatch));
+    }
+
+    auto finish() -> PatchTextOutput {
+        m_collectionIndex.dropCurrentIfEmpty();
+        return std::move(m_result);
+    }
+
+   private:
+    PatchTextOutput m_result;
+    CollectionIndex<std::pmr::list<PatchCollection>> m_collectionIndex;
+};
+
+// where readPchtxt starts. A Patch Text can be parsed in chunks that start at a bid flag, each starting with the
+// state the lines before it left
+struct ParseStart {
+    int lineNum = 1;
+    int offsetShift = 0;
+    bool isBigEndian = false;
+    std::string_view lastComment;
+    bool isFirstChunk = true;  // collects the meta
+    bool isLastChunk = true;   // ends the Patch Text
+};
+
+// buffers of readPchtxt, which a Parser keeps from one Patch Text to the next so they stop allocating once they are
+// large enough
+struct ParseScratch {
+    std::pmr::memory_resource* memoryResource;  // for the collection states, which are only kept during the parse
+    std::string lineBuffer;
+    PatchTextMeta meta;
+    std::string legacyTitle;
+    std::string lastCommentLine;
+    std::string curPatchName;
+    std::string curPatchAuthor;
+    std::vector<uint8_t> valueBuffer;
+
+    explicit ParseScratch(std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource())
+        : memoryResource(memoryResource) {}
+};
+
+template <typename LineReader, typename Sink>
+auto readPchtxt(LineReader& reader, PatchTextHandler& handler, Sink& sink, ParseScratch& scratch,
+                const ParseStart& start = {}) -> bool {
+    // meta is collected in the same pass, from the lines before the first empty line
+    auto& meta = scratch.meta;
+    meta.title.clear();
+    meta.programId.clear();
+    meta.url.clear();
+    auto metaParser = MetaParser{meta, scratch.legacyTitle};
+    auto isParsingMeta = [&] { return start.isFirstChunk and not metaParser.isDone(); };
+    auto curLineNum = start.lineNum;
+    auto finishMeta = [&] {
+        metaParser.finish(curLineNum, sink);
+        handler.onMeta(meta);
+    };
 
     // parsing status
-    auto curLineNum = 1;
-    auto lastCommentLine = std::string{};
-    auto curPatch = Patch{};
-    auto curPatchCollection = PatchCollection{};
-    auto curOffsetShift = 0;
-    auto curIsBigEndian = false;
+    auto& lastCommentLine = scratch.lastCommentLine;
+    lastCommentLine = start.lastComment;
+    auto collections = std::pmr::list<CollectionState>{scratch.memoryResource};
+    auto collectionIndex = CollectionIndex{collections};
+    auto curOffsetShift = start.offsetShift;
+    auto curIsBigEndian = start.isBigEndian;
     auto isAcceptingPatch = false;
+    auto isRecovering = sink.isRecovering();  // skips the lines and patches with errors instead of stopping
     auto stopParsing = false;
     auto logDebugInfo = false;
 
-    auto line = std::string{};
+    // the current patch. A patch without contents is not ended by the next one, which takes over its type
+    auto& curPatchName = scratch.curPatchName;
+    auto& curPatchAuthor = scratch.curPatchAuthor;
+    curPatchName.clear();
+    curPatchAuthor.clear();
+    auto curPatchType = BIN;
+    auto curPatchEnabled = false;
+    auto curPatchLineNum = 0;
+    auto curPatchContentCount = size_t{0};
+    auto isInPatch = false;
+    auto& valueBuffer = scratch.valueBuffer;
+
+    auto rawLine = std::string_view{};
+    // errors and warnings point at the part of the line they are about
+    auto report = [&](DiagnosticLevel level, DiagnosticCode code, std::string_view subject = {}, int column = 0) {
+        if (level <= LEVEL_WARNING and column == 0 and not subject.empty()) {
+            column = static_cast<int>(subject.data() - rawLine.data()) + 1;
+        }
+        sink.report({.level = level, .code = code, .lineNum = curLineNum, .column = column, .subject = subject});
+    };
+
+    auto startPatch = [&] {
+        isInPatch = true;
+        handler.onPatchStart({curPatchName, curPatchAuthor, curPatchType, curPatchEnabled, curPatchLineNum});
+    };
+    auto endPatch = [&] {
+        if (not isInPatch) return;
+        isInPatch = false;
+        if (curPatchContentCount > 0) {
+            report(LEVEL_INFO, DiagnosticCode::PATCH_READ, curPatchName);
+            collectionIndex.current()->hasPatches = true;
+        }
+        handler.onPatchEnd();
+    };
+    auto resetPatch = [&] {
+        curPatchName.clear();
+        curPatchAuthor.clear();
+        curPatchType = BIN;
+        curPatchEnabled = false;
+        curPatchLineNum = 0;
+        curPatchContentCount = 0;
+    };
+
     while (true) {
         if (stopParsing) break;
 
-        if (not std::getline(input, line)) {
-            logOs << "done parsing patches" << std::endl;
+        if (not reader.next(rawLine)) {
+            if (not start.isLastChunk) break;
+            if (isParsingMeta()) {
+                report(LEVEL_INFO, DiagnosticCode::META_END_OF_FILE);
+                finishMeta();
+            }
+            report(LEVEL_INFO, DiagnosticCode::PARSING_DONE);
             break;
         }
-        trim(line);
-        auto lineNoComment = getLineNoComment(line);
-        auto lineNoCommentLower = getStringToLowerCase(lineNoComment);
+        auto line = lexLine(rawLine);
+        if (isParsingMeta()) {
+            metaParser.parseLine(line, curLineNum, sink);
+            if (metaParser.isDone()) handler.onMeta(meta);
+        }
+        auto lineNoComment = line.noComment;
 
-        switch (line[0]) {
-            case '@': {  // tags
-                auto curTag = firstToken(lineNoCommentLower);
+        switch (line.kind) {
+            case LineKind::TAG: {  // tags
+                auto curTag = firstToken(lineNoComment);
+                auto tag = lookup(TAGS, curTag);
 
-                if (curTag == STOP_PARSING_TAG) {  // stop parsing
-                    logOs << "L" << curLineNum << ": done parsing patches (reached tag @stop)" << std::endl;
+                if (tag == Tag::STOP_PARSING) {  // stop parsing
+                    report(LEVEL_INFO, DiagnosticCode::PARSING_STOPPED);
                     stopParsing = true;
                     break;
 
-                } else if (curTag == ENABLED_TAG or curTag == DISABLED_TAG) {  // start of a new patch
+                } else if (tag == Tag::ENABLED or tag == Tag::DISABLED) {  // start of a new patch
                     // store current
-                    if (curPatchCollection.buildId.empty()) {
-                        logOs << "L" << curLineNum << ": ERROR: missing build id, abort parsing" << std::endl;
-                        return {};
+                    auto* curPatchCollection = collectionIndex.current();
+                    if (not curPatchCollection or curPatchCollection->buildId.empty()) {
+                        report(LEVEL_ERROR, DiagnosticCode::MISSING_BUILD_ID);
+                        if (not isRecovering) return false;
+                        isAcceptingPatch = false;  // skip the patch
+                        break;
                     }
 
-                    if (not curPatch.contents.empty()) {
-                        curPatchCollection.patches.push_back(curPatch);
-                        logOs << "L" << curLineNum << ": patch read: " << curPatch.name << std::endl;
-                        // start new patch
-                        curPatch = Patch{};
-                    }
+                    auto isPatchRead = curPatchContentCount > 0;
+                    endPatch();
+                    if (isPatchRead) resetPatch();  // start new patch
 
-                    if (curTag == ENABLED_TAG) {
-                        curPatch.enabled = true;
+                    if (tag == Tag::ENABLED) {
+                        curPatchEnabled = true;
                     } else {
-                        curPatch.enabled = false;
+                        curPatchEnabled = false;
                     }
 
-                    curPatch.lineNum = curLineNum;
+                    curPatchLineNum = curLineNum;
 
-                    if (curPatch.type != AMS) {  // don't use last comment on AMS style patch titles
+                    if (curPatchType != AMS) {  // don't use last comment on AMS style patch titles
                         // extract name and author from last comment
-                        auto authorStartPos = lastCommentLine.rfind(AUTHOR_IDENTIFIER_OPEN);
-                        auto authorEndPos = lastCommentLine.rfind(AUTHOR_IDENTIFIER_CLOSE);
-                        auto patchName = lastCommentLine.substr(0, authorStartPos);
-                        rtrim(patchName);
-                        auto author =
-                            authorStartPos != std::string::npos
-                                ? lastCommentLine.substr(authorStartPos + 1, authorEndPos - authorStartPos - 1)
-                                : std::string{};
-                        trim(author);
-                        curPatch.name = patchName;
-                        curPatch.author = author;
+                        auto lastComment = std::string_view{lastCommentLine};
+                        auto authorStartPos = lastComment.rfind(AUTHOR_IDENTIFIER_OPEN);
+                        auto authorEndPos = lastComment.rfind(AUTHOR_IDENTIFIER_CLOSE);
+                        curPatchName = rtrim(lastComment.substr(0, authorStartPos));
+                        curPatchAuthor =
+                            authorStartPos != std::string_view::npos
+                                ? trim(lastComment.substr(authorStartPos + 1, authorEndPos - authorStartPos - 1))
+                                : std::string_view{};
                     }
 
                     // check patch type
-                    auto lineAfterTag = lineNoCommentLower.substr(curTag.size());
-                    ltrim(lineAfterTag);
-                    auto patchType = firstToken(lineAfterTag);
-                    if (patchType == PATCH_TYPE_HEAP) {
-                        curPatch.type = HEAP;
-                    } else if (patchType == PATCH_TYPE_AMS) {
-                        curPatch.type = AMS;
+                    auto patchType = firstToken(ltrim(lineNoComment.substr(curTag.size())));
+                    if (isEqualIgnoreCase(patchType, PATCH_TYPE_HEAP)) {
+                        curPatchType = HEAP;
+                    } else if (isEqualIgnoreCase(patchType, PATCH_TYPE_AMS)) {
+                        curPatchType = AMS;
                     }
 
                     isAcceptingPatch = true;
+                    startPatch();
 
-                    if (logDebugInfo) logOs << "L" << curLineNum << ": parsing patch: " << curPatch.name << std::endl;
+                    if (logDebugInfo) report(LEVEL_DEBUG, DiagnosticCode::PATCH_START, curPatchName);
 
-                } else if (curTag == FLAG_TAG) {  // parse flag
-                    auto flagContent = lineNoComment.substr(curTag.size());
-                    ltrim(flagContent);
+                } else if (tag == Tag::FLAG) {  // parse flag
+                    auto flagContent = ltrim(lineNoComment.substr(curTag.size()));
                     auto flagType = firstToken(flagContent);
-                    ltrim(flagType);
-                    auto flagValue = flagContent.substr(flagType.size());
-                    ltrim(flagValue);
-                    flagType = getStringToLowerCase(flagType);
+                    auto flagValue = ltrim(flagContent.substr(flagType.size()));
+                    auto flag = lookup(FLAGS, flagType);
 
-                    if (flagType == BIG_ENDIAN_FLAG) {
+                    if (flag == Flag::BIG_ENDIAN_ORDER) {
                         curIsBigEndian = true;
 
-                    } else if (flagType == LITTLE_ENDIAN_FLAG) {
+                    } else if (flag == Flag::LITTLE_ENDIAN_ORDER) {
                         curIsBigEndian = false;
 
-                    } else if (flagType == NSOBID_FLAG or flagType == NROBID_FLAG) {
+                    } else if (flag == Flag::NSOBID or flag == Flag::NROBID) {
                         // wrap up last bid collection
-                        if (not curPatch.contents.empty()) {
-                            curPatchCollection.patches.push_back(curPatch);
-                            logOs << "L" << curLineNum << ": patch read: " << curPatch.name << std::endl;
-                        }
-                        curPatch = Patch{};
-                        if (not curPatchCollection.patches.empty()) {
-                            result.collections.push_back(curPatchCollection);
-                            if (logDebugInfo)
-                                logOs << "L" << curLineNum << ": parsing stopped for " << curPatchCollection.buildId
-                                      << std::endl;
-                            curPatchCollection = PatchCollection{};
+                        if (auto* lastPatchCollection = collectionIndex.current()) {
+                            endPatch();
+                            if (logDebugInfo and lastPatchCollection->hasPatches)
+                                report(LEVEL_DEBUG, DiagnosticCode::COLLECTION_STOP, lastPatchCollection->buildId);
+                            handler.onCollectionEnd();
                         }
+                        resetPatch();
 
-                        // check if new bid exist
-                        auto existingCollection = std::find_if(
-                            begin(result.collections), end(result.collections),
-                            [flagValue](PatchCollection& collection) { return collection.buildId == flagValue; });
-
-                        if (existingCollection != end(result.collections)) {  // bid already exist
-                            curPatchCollection = *existingCollection;
-                            result.collections.erase(existingCollection);
-                        } else {
-                            // set up patch collection for new bid
-                            curPatchCollection.buildId = flagValue;
-                            if (flagType == NROBID_FLAG) {
-                                curPatchCollection.targetType = NRO;
-                            } else {
-                                curPatchCollection.targetType = NSO;
-                            }
-                        }
+                        // switch to the collection for the new bid, picking up where it was left if it exists
+                        auto targetType = flag == Flag::NROBID ? NRO : NSO;
+                        auto& curPatchCollection = collectionIndex.select(flagValue, targetType);
+                        handler.onCollectionStart(flagValue, targetType);
 
                         isAcceptingPatch = false;  // don't accept anymore patches since we just started new bid
 
                         if (logDebugInfo)
-                            logOs << "L" << curLineNum << ": parsing started for " << curPatchCollection.buildId
-                                  << std::endl;
+                            report(LEVEL_DEBUG, DiagnosticCode::COLLECTION_START, curPatchCollection.buildId);
 
-                    } else if (flagType == OFFSET_SHIFT_FLAG) {
-                        curOffsetShift = std::stoi(flagValue, nullptr, 0);
+                    } else if (flag == Flag::OFFSET_SHIFT) {
+                        if (not parseOffsetShift(flagValue, curOffsetShift)) {
+                            report(LEVEL_ERROR, DiagnosticCode::INVALID_OFFSET_SHIFT, flagValue);
+                            if (not isRecovering) return false;
+                            break;
+                        }
                         if (logDebugInfo)
-                            logOs << "L" << curLineNum << ": offset shift is now " << curOffsetShift << std::endl;
+                            sink.report({.level = LEVEL_DEBUG,
+                                         .code = DiagnosticCode::OFFSET_SHIFT,
+                                         .lineNum = curLineNum,
+                                         .value = curOffsetShift});
 
-                    } else if (flagType == DEBUG_INFO_FLAG or flagType == ALT_DEBUG_INFO_FLAG) {
+                    } else if (flag == Flag::DEBUG_INFO) {
                         logDebugInfo = true;
-                        logOs << "L" << curLineNum << ": additional debug info enabled" << std::endl;
+                        report(LEVEL_INFO, DiagnosticCode::DEBUG_INFO_ENABLED);
 
                     } else {
-                        logOs << "L" << curLineNum << ": WARNING ignored unrecognized flag type: " << flagType
-                              << std::endl;
+                        report(LEVEL_WARNING, DiagnosticCode::UNKNOWN_FLAG, flagType);
                     }
 
-                } else if (isStartsWith(lineNoCommentLower, NSOBID_TAG)) {  // legacy style nsobid
-                    if (not(lineNoCommentLower.size() > std::string_view(NSOBID_TAG).size() + 1)) {
-                        logOs << "L" << curLineNum << ": ERROR: legacy nsobid tag missing value" << std::endl;
-                        return {};
+                } else if (isStartsWithIgnoreCase(lineNoComment, NSOBID_TAG)) {  // legacy style nsobid
+                    if (not(lineNoComment.size() > std::string_view(NSOBID_TAG).size() + 1)) {
+                        report(LEVEL_ERROR, DiagnosticCode::MISSING_LEGACY_BUILD_ID);
+                        if (not isRecovering) return false;
+                        break;
                     }
-                    curPatchCollection.targetType = NSO;
-                    curPatchCollection.buildId = lineNoComment.substr(std::string_view(NSOBID_TAG).size() + 1);
-                    ltrim(curPatchCollection.buildId);
+                    auto buildId = ltrim(lineNoComment.substr(std::string_view(NSOBID_TAG).size() + 1));
+                    auto& curPatchCollection = collectionIndex.rename(buildId);
+                    handler.onCollectionRename(buildId);
 
                     if (logDebugInfo)
-                        logOs << "L" << curLineNum << ": parsing started for " << curPatchCollection.buildId
-                              << " (legacy style bid)" << std::endl;
+                        report(LEVEL_DEBUG, DiagnosticCode::LEGACY_COLLECTION_START, curPatchCollection.buildId);
 
-                } else if (META_TAGS.find(curTag) == end(META_TAGS)) {  // check if tag is bad
-                    logOs << "L" << curLineNum << ": WARNING ignored unrecognized tag: " << curTag << std::endl;
+                } else if (tag == Tag::UNKNOWN) {  // check if tag is bad
+                    report(LEVEL_WARNING, DiagnosticCode::UNKNOWN_TAG, curTag);
                 }
                 break;
             }
 
-            case '#': {  // echo identifier
-                logOs << "L" << curLineNum << ": " << line << std::endl;
+            case LineKind::ECHO: {  // echo identifier
+                report(LEVEL_INFO, DiagnosticCode::ECHO, line.text);
                 break;
             }
 
-            case AMS_CHEAT_IDENTIFIER_OPEN[0]: {  // AMS cheat
+            case LineKind::AMS_CHEAT: {  // AMS cheat
                 // store current
-                if (curPatchCollection.buildId.empty()) {
-                    logOs << "L" << curLineNum << ": ERROR: missing build id, abort parsing" << std::endl;
-                    return {};
+                auto* curPatchCollection = collectionIndex.current();
+                if (not curPatchCollection or curPatchCollection->buildId.empty()) {
+                    report(LEVEL_ERROR, DiagnosticCode::MISSING_BUILD_ID);
+                    if (not isRecovering) return false;
+                    isAcceptingPatch = false;  // skip the cheat
+                    break;
                 }
 
-                if (not curPatch.contents.empty()) {
-                    curPatchCollection.patches.push_back(curPatch);
-                    logOs << "L" << curLineNum << ": patch read: " << curPatch.name << std::endl;
-                }
+                endPatch();
 
                 // start new patch
-                auto amsCheatName = lineNoComment.substr(1, lineNoComment.rfind(AMS_CHEAT_IDENTIFIER_CLOSE) - 1);
-                trim(amsCheatName);
-                curPatch = Patch{amsCheatName, {}, AMS, true, curLineNum, {}};
+                auto amsCheatName = trim(lineNoComment.substr(1, lineNoComment.rfind(AMS_CHEAT_IDENTIFIER_CLOSE) - 1));
+                resetPatch();
+                curPatchName = amsCheatName;
+                curPatchType = AMS;
+                curPatchEnabled = true;
+                curPatchLineNum = curLineNum;
+                startPatch();
 
-                if (logDebugInfo) logOs << "L" << curLineNum << ": parsing AMS cheat: " << curPatch.name << std::endl;
+                if (logDebugInfo) report(LEVEL_DEBUG, DiagnosticCode::AMS_CHEAT_START, curPatchName);
 
                 break;
             }
 
-            case '/': {  // comment identifier
-                lastCommentLine = getLineCommentContent(line);
+            case LineKind::COMMENT: {  // comment identifier
+                lastCommentLine = line.comment;
                 break;
             }
 
-            default: {
-                if (not isAcceptingPatch) break;
+            case LineKind::EMPTY:  // skip empty lines
+                break;
 
-                // skip empty lines
-                if (line.empty()) {
-                    break;
-                }
+            case LineKind::CONTENT: {
+                if (not isAcceptingPatch) break;
 
                 // parse patch contents
-                if (curPatch.type == AMS) {  // for AMS cheats, just add line as plain text
-                    curPatch.contents.push_back({0, {begin(lineNoComment), end(lineNoComment)}});
+                if (curPatchType == AMS) {  // for AMS cheats, just add line as plain text
+                    curPatchContentCount++;
+                    handler.onContent(0, {reinterpret_cast<const uint8_t*>(lineNoComment.data()), lineNoComment.size()});
 
-                    if (logDebugInfo) logOs << "L" << curLineNum << ": AMS cheat: " << lineNoComment << std::endl;
+                    if (logDebugInfo) report(LEVEL_DEBUG, DiagnosticCode::AMS_CHEAT_CONTENT, lineNoComment);
                     break;
                 }
 
                 // parse values
-                auto offsetStr = firstToken(lineNoCommentLower);
-                auto valueStr = lineNoCommentLower.substr(offsetStr.size());
+                auto offsetStr = firstToken(lineNoComment);
+                auto valueStr = ltrim(lineNoComment.substr(offsetStr.size()));
 
                 // check offset
                 if (not stringIsHex(offsetStr)) {
-                    if (logDebugInfo)
-                        logOs << "L" << curLineNum << ": line ignored: invalid offset: " << line << std::endl;
+                    if (logDebugInfo) report(LEVEL_DEBUG, DiagnosticCode::LINE_IGNORED, line.text);
                     break;
                 }
-                trimZeros(offsetStr);
+                offsetStr = trimZeros(offsetStr);
                 if (offsetStr.size() > 8) {
-                    logOs << "L" << curLineNum << ": ERROR: offset: " << offsetStr << " out of range" << std::endl;
-                    return {};
+                    report(LEVEL_ERROR, DiagnosticCode::OFFSET_OUT_OF_RANGE, offsetStr);
+                    if (not isRecovering) return false;
+                    break;
                 }
 
-                auto offset = static_cast<uint32_t>(std::stoul(offsetStr, nullptr, 16)) + curOffsetShift;
-                auto patchContent = PatchContent{offset, {}};
+                auto offset = getHexUInt32(offsetStr) + curOffsetShift;
+                valueBuffer.clear();
 
                 // parse value
-                ltrim(valueStr);
-                if (valueStr[0] == '"') {  // string patch
-                    auto closingPosSearch = begin(valueStr);
+                if (not valueStr.empty() and valueStr[0] == '"') {  // string patch
+                    auto closingPos = size_t{0};
                     while (true) {  // find string closing pos
-                        closingPosSearch++;
-
-                        if ((closingPosSearch = std::find(closingPosSearch, end(valueStr), '"')) == end(valueStr)) {
-                            logOs << "L" << curLineNum << ": ERROR: cannot find string closing: " << valueStr
-                                  << std::endl;
-                            return {};
+                        if ((closingPos = valueStr.find('"', closingPos + 1)) == std::string_view::npos) {
+                            break;
                         }
 
-                        if (*(closingPosSearch - 1) != '\\') {
+                        if (valueStr[closingPos - 1] != '\\') {
                             break;
                         }
                     }
+                    if (closingPos == std::string_view::npos) {
+                        report(LEVEL_ERROR, DiagnosticCode::UNTERMINATED_STRING, valueStr);
+                        if (not isRecovering) return false;
+                        break;
+                    }
 
                     // escape chars
-                    auto stringValueStr = std::string{begin(valueStr) + 1, closingPosSearch};
-                    escapeString(stringValueStr);
-
-                    patchContent.value = {begin(stringValueStr), end(stringValueStr)};
-                    patchContent.value.push_back('\0');
-
-                } else {            // hex values patch
+                    appendEscapedString(valueStr.substr(1, closingPos - 1), valueBuffer);
+                    valueBuffer.push_back('\0');
+
+                } else {  // hex values patch
+                    // tokens are walked with a cursor instead of re-slicing the rest of the line, and decode into
+                    // the reused value buffer
+                    auto cursor = size_t{0};
+                    auto isValueBad = false;
                     while (true) {  // parse value token by token
                         // get next token
-                        auto valueTokenStr = firstToken(valueStr);
-                        valueStr = valueStr.substr(valueTokenStr.size());
-                        ltrim(valueStr);
-                        if (valueTokenStr.empty()) {
+                        while (cursor < valueStr.size() and isSpace(valueStr[cursor])) cursor++;
+                        if (cursor == valueStr.size()) {
                             break;
                         }
+                        auto tokenStart = cursor;
+                        while (cursor < valueStr.size() and not isSpace(valueStr[cursor])) cursor++;
+                        auto valueTokenStr = valueStr.substr(tokenStart, cursor - tokenStart);
 
                         // check token
                         if (valueTokenStr.size() % 2 != 0) {
-                            logOs << "L" << curLineNum << ": ERROR: bad length for hex values: " << valueTokenStr
-                                  << std::endl;
-                            return {};
-                        }
-                        if (not stringIsHex(valueTokenStr)) {
-                            logOs << "L" << curLineNum << ": ERROR: not valid hex values: " << valueTokenStr
-                                  << std::endl;
-                            return {};
+                            report(LEVEL_ERROR, DiagnosticCode::BAD_HEX_LENGTH, valueTokenStr);
+                            if (not isRecovering) return false;
+                            isValueBad = true;
+                            break;
                         }
 
-                        // parse token value
-                        if (curIsBigEndian) {
-                            auto curBytePos = end(valueTokenStr);
-                            while (curBytePos != begin(valueTokenStr)) {
-                                curBytePos -= 2;
-                                patchContent.value.push_back(getHexByte(curBytePos));
-                            }
-                        } else {
-                            for (auto curBytePos = begin(valueTokenStr); curBytePos != end(valueTokenStr);
-                                 curBytePos += 2) {
-                                patchContent.value.push_back(getHexByte(curBytePos));
-                            }
+                        // validate and decode the whole token in one pass
+                        auto valueSize = valueBuffer.size();
+                        valueBuffer.resize(valueSize + valueTokenStr.size() / 2);
+                        auto badCharPos = decodeHex(valueTokenStr, valueBuffer.data() + valueSize, curIsBigEndian);
+                        if (badCharPos != std::string_view::npos) {
+                            report(LEVEL_ERROR, DiagnosticCode::BAD_HEX_VALUE, valueTokenStr,
+                                   static_cast<int>(valueTokenStr.data() + badCharPos - rawLine.data()) + 1);
+                            if (not isRecovering) return false;
+                            isValueBad = true;
+                            break;
                         }
                     }
+                    if (isValueBad) break;  // skip the line
                 }
 
-                curPatch.contents.push_back(patchContent);
                 if (logDebugInfo) {
-                    logOs << "L" << curLineNum << ": offset: " << std::hex << std::setfill('0') << std::setw(8)
-                          << patchContent.offset << " value: ";
-                    for (auto byte : patchContent.value) logOs << std::setw(2) << static_cast<int>(byte);
-                    logOs << std::dec << " len: " << patchContent.value.size() << std::endl;
+                    sink.report({.level = LEVEL_DEBUG,
+                                 .code = DiagnosticCode::CONTENT,
+                                 .lineNum = curLineNum,
+                                 .value = offset,
+                                 .bytes = valueBuffer});
                 }
+                curPatchContentCount++;
+                handler.onContent(offset, valueBuffer);
             }
         }
 
@@ -511,101 +954,621 @@ auto parsePchtxt(std::istream& input, std::ostream& logOs) -> PatchTextOutput {
     }
 
     // add last patch and collection
-    if (not curPatch.contents.empty()) {
-        curPatchCollection.patches.push_back(curPatch);
-        logOs << "L" << curLineNum << ": patch read: " << curPatch.name << std::endl;
+    if (auto* curPatchCollection = collectionIndex.current()) {
+        endPatch();
+        if (logDebugInfo and curPatchCollection->hasPatches)
+            report(LEVEL_DEBUG, DiagnosticCode::COLLECTION_DONE, curPatchCollection->buildId);
+        handler.onCollectionEnd();
     }
-    if (not curPatchCollection.patches.empty()) {
-        result.collections.push_back(curPatchCollection);
-        if (logDebugInfo)
-            logOs << "L" << curLineNum << ": parsing completed for " << curPatchCollection.buildId << std::endl;
+
+    return true;
+}
+
+inline auto makeLineReader(std::istream& input, ParseScratch& scratch) {
+    return IstreamLineReader{input, scratch.lineBuffer};
+}
+
+inline auto makeLineReader(std::span<const char> input, ParseScratch&) { return SpanLineReader{input}; }
+
+template <typename Input, typename Sink>
+auto buildPchtxt(Input& input, Sink& sink, std::pmr::memory_resource* memoryResource, ParseScratch& scratch)
+    -> PatchTextOutput {
+    auto builder = PatchTextBuilder{memoryResource};
+    auto reader = makeLineReader(input, scratch);
+    if (not readPchtxt(reader, builder, sink, scratch)) return {};
+    return builder.finish();
+}
+
+// collects the patches of one chunk by the collection they were read into, to be merged in order once every chunk
+// is parsed
+class ChunkBuilder : public PatchBuilder {
+   public:
+    struct Section {
+        bool isSelected = false;  // only the section before the first bid flag of the first chunk is not
+        std::string buildId;
+        TargetType targetType = NSO;
+        std::vector<std::string> renames;  // legacy style bids, which name the selected collection
+        std::pmr::list<Patch> patches;
+    };
+
+    explicit ChunkBuilder(std::pmr::memory_resource* memoryResource)
+        : PatchBuilder(Allocator{memoryResource}), m_meta(Allocator{memoryResource}) {
+        m_sections.push_back({false, {}, NSO, {}, std::pmr::list<Patch>{Allocator{memoryResource}}});
     }
 
+    void onMeta(const PatchTextMeta& meta) override { m_meta = meta; }
+
+    void onCollectionStart(std::string_view buildId, TargetType targetType) override {
+        m_sections.push_back({true, std::string{buildId}, targetType, {}, std::pmr::list<Patch>{get_allocator()}});
+    }
+
+    void onCollectionRename(std::string_view buildId) override { m_sections.back().renames.emplace_back(buildId); }
+
+    void onPatchEnd() override {
+        if (not m_curPatch.contents.empty()) m_sections.back().patches.push_back(std::move(m_curPatch));
+    }
+
+    auto meta() -> PatchTextMeta& { return m_meta; }
+
+    auto sections() -> std::vector<Section>& { return m_sections; }
+
+    auto get_allocator() const -> Allocator { return m_curPatch.get_allocator(); }
+
+   private:
+    PatchTextMeta m_meta;
+    std::vector<Section> m_sections;
+};
+
+struct Chunk {
+    size_t pos;
+    ParseStart start;
+};
+
+// splits a Patch Text at bid flags into chunks of at least minChunkSize bytes, which parse the same on their own
+// as in one pass when started with the state the lines before them leave. Returns no chunks if that cannot be done,
+// when debug info is enabled or the meta does not end before a bid flag
+inline auto splitPchtxt(std::string_view input, size_t minChunkSize) -> std::vector<Chunk> {
+    auto result = std::vector<Chunk>{{0, {}}};
+    auto state = ParseStart{};
+    auto isMetaDone = false;
+    auto reader = SpanLineReader{{input.data(), input.size()}};
+
+    auto rawLine = std::string_view{};
+    for (; reader.next(rawLine); state.lineNum++) {
+        // only tags, comments and the end of the meta matter, so other lines are not lexed
+        auto lineStart = ltrim(rawLine);
+        if (lineStart.empty()) {
+            isMetaDone = true;
+            continue;
+        }
+        if (lineStart[0] == COMMENT_IDENTIFIER[0]) {
+            state.lastComment = lexLine(rawLine).comment;
+            continue;
+        }
+        if (lineStart[0] != TAG_IDENTIFIER[0]) continue;
+
+        auto lineNoComment = lexLine(rawLine).noComment;
+        auto curTag = firstToken(lineNoComment);
+        auto tag = lookup(TAGS, curTag);
+        if (tag == Tag::STOP_PARSING) break;
+        if (tag != Tag::FLAG) continue;
+
+        auto flagContent = ltrim(lineNoComment.substr(curTag.size()));
+        auto flagType = firstToken(flagContent);
+        auto flagValue = ltrim(flagContent.substr(flagType.size()));
+        auto flag = lookup(FLAGS, flagType);
+
+        if (flag == Flag::BIG_ENDIAN_ORDER or flag == Flag::LITTLE_ENDIAN_ORDER) {
+            state.isBigEndian = flag == Flag::BIG_ENDIAN_ORDER;
+
+        } else if (flag == Flag::OFFSET_SHIFT) {
+            // an offset shift that does not parse ends the parse in its chunk, so the chunks after it do not matter
+            parseOffsetShift(flagValue, state.offsetShift);
+
+        } else if (flag == Flag::DEBUG_INFO) {  // debug info logs across chunk boundaries
+            return {};
+
+        } else if (flag == Flag::NSOBID or flag == Flag::NROBID) {
+            if (not isMetaDone) return {};
+            auto pos = static_cast<size_t>(rawLine.data() - input.data());
+            if (pos - result.back().pos < minChunkSize) continue;
+            result.push_back({pos, state});
+            result.back().start.isFirstChunk = false;
+        }
+    }
+
+    for (auto chunk = begin(result); chunk + 1 != end(result); chunk++) chunk->start.isLastChunk = false;
     return result;
 }
 
-auto getPchtxtMeta(std::istream& input) -> PatchTextMeta {
-    auto throwAwaySs = std::stringstream{};
-    return getPchtxtMeta(input, throwAwaySs);
+auto parsePchtxt(std::istream& input, std::pmr::memory_resource* memoryResource) -> PatchTextOutput {
+    auto sink = NullSink{};
+    auto scratch = ParseScratch{};
+    return buildPchtxt(input, sink, memoryResource, scratch);
 }
 
-auto getPchtxtMeta(std::istream& input, std::ostream& logOs) -> PatchTextMeta {
-    auto result = PatchTextMeta{};
-    auto tagToValueMap = std::unordered_map<std::string_view, std::string&>{
-        {TITLE_TAG, result.title}, {PROGRAM_ID_TAG, result.programId}, {URL_TAG, result.url}};
+auto parsePchtxt(std::istream& input, std::ostream& logOs, std::pmr::memory_resource* memoryResource)
+    -> PatchTextOutput {
+    auto sink = OstreamSink{logOs};
+    return parsePchtxt(input, sink, memoryResource);
+}
 
-    auto legacyTitle = std::string{};
+auto parsePchtxt(std::istream& input, DiagnosticSink& sink, std::pmr::memory_resource* memoryResource)
+    -> PatchTextOutput {
+    auto scratch = ParseScratch{};
+    return buildPchtxt(input, sink, memoryResource, scratch);
+}
 
-    auto curLineNum = 1;
-    auto line = std::string{};
-    while (true) {
-        if (not std::getline(input, line)) {
-            logOs << "meta parsing reached end of file" << std::endl;
-            break;
-        }
-        trim(line);
+auto parsePchtxt(std::span<const char> input, std::pmr::memory_resource* memoryResource) -> PatchTextOutput {
+    auto sink = NullSink{};
+    auto scratch = ParseScratch{};
+    return buildPchtxt(input, sink, memoryResource, scratch);
+}
 
-        // meta should stop at an empty line
-        if (line.empty()) {
-            logOs << "L" << curLineNum << ": done parsing meta" << std::endl;
-            break;
-        }
+auto parsePchtxt(std::span<const char> input, std::ostream& logOs, std::pmr::memory_resource* memoryResource)
+    -> PatchTextOutput {
+    auto sink = OstreamSink{logOs};
+    return parsePchtxt(input, sink, memoryResource);
+}
 
-        line = getLineNoComment(line);
-        auto lineLower = getStringToLowerCase(line);
+auto parsePchtxt(std::span<const char> input, DiagnosticSink& sink, std::pmr::memory_resource* memoryResource)
+    -> PatchTextOutput {
+    auto scratch = ParseScratch{};
+    return buildPchtxt(input, sink, memoryResource, scratch);
+}
 
-        if (line[0] == '@') {
-            auto curTag = firstToken(lineLower);
-            if (curTag == STOP_PARSING_TAG) {
-                logOs << "done parsing meta (reached tag @stop)" << std::endl;
-                break;
-            }
+auto parsePchtxt(std::span<const char> input, std::ostream& logOs, const ParallelFor& parallelFor,
+                 std::pmr::memory_resource* memoryResource) -> PatchTextOutput {
+    auto inputStr = std::string_view{input.data(), input.size()};
+    auto chunks = splitPchtxt(inputStr, MIN_PARALLEL_CHUNK_SIZE);
+    if (chunks.size() < 2) return parsePchtxt(input, logOs, memoryResource);
+
+    // memory resources are generally not thread safe, so unless the output's is new_delete_resource, which is, each
+    // chunk allocates from an arena of its own, and the merge moves the patches into the output's memory resource
+    auto isSharedResource = memoryResource->is_equal(*std::pmr::new_delete_resource());
+    auto chunkArenas = std::vector<std::unique_ptr<Arena>>{};
+    auto builders = std::vector<ChunkBuilder>{};
+    builders.reserve(chunks.size());
+    for (auto i = size_t{0}; i < chunks.size(); i++) {
+        if (isSharedResource) {
+            builders.emplace_back(memoryResource);
+        } else {
+            chunkArenas.push_back(std::make_unique<Arena>(64 * 1024, std::pmr::new_delete_resource()));
+            builders.emplace_back(chunkArenas.back().get());
+        }
+    }
+    auto chunkLogs = std::vector<std::ostringstream>(chunks.size());
+    auto isChunkParsed = std::vector<char>(chunks.size());
+
+    parallelFor(chunks.size(), [&](size_t i) {
+        auto chunkEnd = i + 1 < chunks.size() ? chunks[i + 1].pos : inputStr.size();
+        auto sink = OstreamSink{chunkLogs[i]};
+        auto scratch = ParseScratch{builders[i].get_allocator().resource()};
+        auto reader = SpanLineReader{inputStr.substr(chunks[i].pos, chunkEnd - chunks[i].pos)};
+        isChunkParsed[i] = readPchtxt(reader, builders[i], sink, scratch, chunks[i].start);
+    });
 
-            auto curTagFound = tagToValueMap.find(curTag);
-            if (curTagFound != end(tagToValueMap)) {
-                auto curTagValue = line.substr(curTag.size());
-                ltrim(curTagValue);
-                // strip quatation marks if necessary
-                if (curTagValue[0] == '"' and curTagValue[curTagValue.size() - 1] == '"') {
-                    curTagValue = curTagValue.substr(1, curTagValue.size() - 2);
+    // merged in order, the same way the single pass builds the collections, and up to the first error
+    auto result = PatchTextOutput{Allocator{memoryResource}};
+    auto collectionIndex = CollectionIndex{result.collections};
+    for (auto i = size_t{0}; i < chunks.size(); i++) {
+        logOs << chunkLogs[i].view();
+        if (not isChunkParsed[i]) return {};
+
+        for (auto& section : builders[i].sections()) {
+            if (section.isSelected) collectionIndex.select(section.buildId, section.targetType);
+            for (auto& buildId : section.renames) collectionIndex.rename(buildId);
+            if (not section.patches.empty()) {
+                auto& patches = collectionIndex.current()->patches;
+                if (patches.get_allocator() == section.patches.get_allocator()) {
+                    patches.splice(end(patches), section.patches);
+                } else {
+                    for (auto& patch : section.patches) patches.push_back(std::move(patch));
                 }
-                curTagFound->second = curTagValue;
-                logOs << "L" << curLineNum << ": meta: " << curTag << "=" << curTagValue << std::endl;
             }
-        } else if (line[0] == '#') {  // echo identifier
-            logOs << "L" << curLineNum << ": " << line << std::endl;
-            legacyTitle = line.substr(1);
-            ltrim(legacyTitle);
         }
+    }
+    collectionIndex.dropCurrentIfEmpty();
+    result.meta = std::move(builders.front().meta());
 
-        curLineNum++;
+    return result;
+}
+
+auto parsePchtxt(std::istream& input, PatchTextHandler& handler) -> bool {
+    auto sink = NullSink{};
+    auto scratch = ParseScratch{};
+    auto reader = makeLineReader(input, scratch);
+    return readPchtxt(reader, handler, sink, scratch);
+}
+
+auto parsePchtxt(std::istream& input, PatchTextHandler& handler, std::ostream& logOs) -> bool {
+    auto sink = OstreamSink{logOs};
+    return parsePchtxt(input, handler, sink);
+}
+
+auto parsePchtxt(std::istream& input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool {
+    auto scratch = ParseScratch{};
+    auto reader = makeLineReader(input, scratch);
+    return readPchtxt(reader, handler, sink, scratch);
+}
+
+auto parsePchtxt(std::span<const char> input, PatchTextHandler& handler) -> bool {
+    auto sink = NullSink{};
+    auto scratch = ParseScratch{};
+    auto reader = makeLineReader(input, scratch);
+    return readPchtxt(reader, handler, sink, scratch);
+}
+
+auto parsePchtxt(std::span<const char> input, PatchTextHandler& handler, std::ostream& logOs) -> bool {
+    auto sink = OstreamSink{logOs};
+    return parsePchtxt(input, handler, sink);
+}
+
+auto parsePchtxt(std::span<const char> input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool {
+    auto scratch = ParseScratch{};
+    auto reader = makeLineReader(input, scratch);
+    return readPchtxt(reader, handler, sink, scratch);
+}
+
+auto getPchtxtMeta(std::istream& input) -> PatchTextMeta {
+    auto sink = NullSink{};
+    auto lineBuffer = std::string{};
+    auto reader = IstreamLineReader{input, lineBuffer};
+    return readPchtxtMeta(reader, sink);
+}
+
+auto getPchtxtMeta(std::istream& input, std::ostream& logOs) -> PatchTextMeta {
+    auto sink = OstreamSink{logOs};
+    auto lineBuffer = std::string{};
+    auto reader = IstreamLineReader{input, lineBuffer};
+    return readPchtxtMeta(reader, sink);
+}
+
+auto getPchtxtMeta(std::span<const char> input) -> PatchTextMeta {
+    auto sink = NullSink{};
+    auto reader = SpanLineReader{input};
+    return readPchtxtMeta(reader, sink);
+}
+
+auto getPchtxtMeta(std::span<const char> input, std::ostream& logOs) -> PatchTextMeta {
+    auto sink = OstreamSink{logOs};
+    auto reader = SpanLineReader{input};
+    return readPchtxtMeta(reader, sink);
+}
+
+// the text of a diagnostic's log line, after the line number
+auto writeDiagnosticMessage(std::ostream& os, const Diagnostic& diagnostic) -> std::ostream& {
+    auto subject = diagnostic.subject;
+    switch (diagnostic.code) {
+        case DiagnosticCode::MISSING_BUILD_ID:
+            return os << "ERROR: missing build id";
+        case DiagnosticCode::MISSING_LEGACY_BUILD_ID:
+            return os << "ERROR: legacy nsobid tag missing value";
+        case DiagnosticCode::INVALID_OFFSET_SHIFT:
+            return os << "ERROR: invalid offset shift: " << subject;
+        case DiagnosticCode::OFFSET_OUT_OF_RANGE:
+            return os << "ERROR: offset: " << LowerCase{subject} << " out of range";
+        case DiagnosticCode::UNTERMINATED_STRING:
+            return os << "ERROR: cannot find string closing: " << LowerCase{subject};
+        case DiagnosticCode::BAD_HEX_LENGTH:
+            return os << "ERROR: bad length for hex values: " << LowerCase{subject};
+        case DiagnosticCode::BAD_HEX_VALUE:
+            return os << "ERROR: not valid hex values: " << LowerCase{subject} << " (bad character at column "
+                      << diagnostic.column << ")";
+        case DiagnosticCode::UNKNOWN_FLAG:
+            return os << "WARNING ignored unrecognized flag type: " << LowerCase{subject};
+        case DiagnosticCode::UNKNOWN_TAG:
+            return os << "WARNING ignored unrecognized tag: " << LowerCase{subject};
+        case DiagnosticCode::ECHO:
+            return os << subject;
+        case DiagnosticCode::LEGACY_TITLE:
+            return os << "using \"" << subject << "\" as legacy style title";
+        case DiagnosticCode::META_STOPPED:
+            return os << "done parsing meta (reached tag @stop)";
+        case DiagnosticCode::META_END_OF_FILE:
+            return os << "meta parsing reached end of file";
+        case DiagnosticCode::PARSING_DONE:
+            return os << "done parsing patches";
+        case DiagnosticCode::META_TITLE:
+            return os << "meta: " << TITLE_TAG << "=" << subject;
+        case DiagnosticCode::META_PROGRAM_ID:
+            return os << "meta: " << PROGRAM_ID_TAG << "=" << subject;
+        case DiagnosticCode::META_URL:
+            return os << "meta: " << URL_TAG << "=" << subject;
+        case DiagnosticCode::META_DONE:
+            return os << "done parsing meta";
+        case DiagnosticCode::DEBUG_INFO_ENABLED:
+            return os << "additional debug info enabled";
+        case DiagnosticCode::PATCH_READ:
+            return os << "patch read: " << subject;
+        case DiagnosticCode::PARSING_STOPPED:
+            return os << "done parsing patches (reached tag @stop)";
+        case DiagnosticCode::COLLECTION_START:
+            return os << "parsing started for " << subject;
+        case DiagnosticCode::LEGACY_COLLECTION_START:
+            return os << "parsing started for " << subject << " (legacy style bid)";
+        case DiagnosticCode::COLLECTION_STOP:
+            return os << "parsing stopped for " << subject;
+        case DiagnosticCode::COLLECTION_DONE:
+            return os << "parsing completed for " << subject;
+        case DiagnosticCode::OFFSET_SHIFT:
+            return os << "offset shift is now " << diagnostic.value;
+        case DiagnosticCode::PATCH_START:
+            return os << "parsing patch: " << subject;
+        case DiagnosticCode::AMS_CHEAT_START:
+            return os << "parsing AMS cheat: " << subject;
+        case DiagnosticCode::AMS_CHEAT_CONTENT:
+            return os << "AMS cheat: " << subject;
+        case DiagnosticCode::CONTENT: {
+            auto fill = os.fill('0');
+            os << "offset: " << std::hex << std::setw(8) << diagnostic.value << " value: ";
+            for (auto byte : diagnostic.bytes) os << std::setw(2) << static_cast<int>(byte);
+            os.fill(fill);
+            return os << std::dec << " len: " << diagnostic.bytes.size();
+        }
+        case DiagnosticCode::LINE_IGNORED:
+            return os << "line ignored: invalid offset: " << subject;
     }
+    return os;
+}
 
-    if (result.title.empty()) {
-        result.title = legacyTitle;
-        logOs << "using \"" << legacyTitle << "\" as legacy style title" << std::endl;
+auto operator<<(std::ostream& os, const Diagnostic& diagnostic) -> std::ostream& {
+    // these were always logged without their line
+    auto isLoggedWithLine = diagnostic.code != DiagnosticCode::LEGACY_TITLE and
+                            diagnostic.code != DiagnosticCode::META_STOPPED and
+                            diagnostic.code != DiagnosticCode::META_END_OF_FILE and
+                            diagnostic.code != DiagnosticCode::PARSING_DONE;
+    if (isLoggedWithLine) os << "L" << diagnostic.lineNum << ": ";
+    writeDiagnosticMessage(os, diagnostic);
+    // only a recovering sink gets parsing to go on after an error, which an OstreamSink is not
+    if (diagnostic.code == DiagnosticCode::MISSING_BUILD_ID) os << ", abort parsing";
+    return os;
+}
+
+auto getDiagnosticCodeName(DiagnosticCode code) -> std::string_view {
+    switch (code) {
+        case DiagnosticCode::MISSING_BUILD_ID:
+            return "missing_build_id";
+        case DiagnosticCode::MISSING_LEGACY_BUILD_ID:
+            return "missing_legacy_build_id";
+        case DiagnosticCode::INVALID_OFFSET_SHIFT:
+            return "invalid_offset_shift";
+        case DiagnosticCode::OFFSET_OUT_OF_RANGE:
+            return "offset_out_of_range";
+        case DiagnosticCode::UNTERMINATED_STRING:
+            return "unterminated_string";
+        case DiagnosticCode::BAD_HEX_LENGTH:
+            return "bad_hex_length";
+        case DiagnosticCode::BAD_HEX_VALUE:
+            return "bad_hex_value";
+        case DiagnosticCode::UNKNOWN_FLAG:
+            return "unknown_flag";
+        case DiagnosticCode::UNKNOWN_TAG:
+            return "unknown_tag";
+        case DiagnosticCode::ECHO:
+            return "echo";
+        case DiagnosticCode::META_TITLE:
+            return "meta_title";
+        case DiagnosticCode::META_PROGRAM_ID:
+            return "meta_program_id";
+        case DiagnosticCode::META_URL:
+            return "meta_url";
+        case DiagnosticCode::LEGACY_TITLE:
+            return "legacy_title";
+        case DiagnosticCode::META_DONE:
+            return "meta_done";
+        case DiagnosticCode::META_STOPPED:
+            return "meta_stopped";
+        case DiagnosticCode::META_END_OF_FILE:
+            return "meta_end_of_file";
+        case DiagnosticCode::DEBUG_INFO_ENABLED:
+            return "debug_info_enabled";
+        case DiagnosticCode::PATCH_READ:
+            return "patch_read";
+        case DiagnosticCode::PARSING_STOPPED:
+            return "parsing_stopped";
+        case DiagnosticCode::PARSING_DONE:
+            return "parsing_done";
+        case DiagnosticCode::COLLECTION_START:
+            return "collection_start";
+        case DiagnosticCode::LEGACY_COLLECTION_START:
+            return "legacy_collection_start";
+        case DiagnosticCode::COLLECTION_STOP:
+            return "collection_stop";
+        case DiagnosticCode::COLLECTION_DONE:
+            return "collection_done";
+        case DiagnosticCode::OFFSET_SHIFT:
+            return "offset_shift";
+        case DiagnosticCode::PATCH_START:
+            return "patch_start";
+        case DiagnosticCode::AMS_CHEAT_START:
+            return "ams_cheat_start";
+        case DiagnosticCode::AMS_CHEAT_CONTENT:
+            return "ams_cheat_content";
+        case DiagnosticCode::CONTENT:
+            return "content";
+        case DiagnosticCode::LINE_IGNORED:
+            return "line_ignored";
     }
+    return "unknown";
+}
 
-    return result;
+auto getDiagnosticLevelName(DiagnosticLevel level) -> std::string_view {
+    switch (level) {
+        case LEVEL_ERROR:
+            return "error";
+        case LEVEL_WARNING:
+            return "warning";
+        case LEVEL_INFO:
+            return "info";
+        case LEVEL_DEBUG:
+            return "debug";
+    }
+    return "unknown";
+}
+
+void DiagnosticCollector::report(const Diagnostic& diagnostic) {
+    if (diagnostic.level == LEVEL_ERROR) m_errorCount++;
+    if (diagnostic.level > m_maxLevel) return;
+    auto message = std::ostringstream{};
+    writeDiagnosticMessage(message, diagnostic);
+    m_diagnostics.push_back(
+        {diagnostic.level, diagnostic.code, diagnostic.lineNum, diagnostic.column, std::move(message).str()});
+}
+
+Parser::Parser() : m_output(Allocator{&m_arena}), m_scratch(std::make_unique<ParseScratch>(&m_arena)) {}
+
+Parser::~Parser() = default;
+
+void Parser::startParse() {
+    // the last output has to let go of its memory before the arena hands it out again
+    m_output = PatchTextOutput{Allocator{&m_arena}};
+    m_arena.reset();
+}
+
+template <typename Input, typename Sink>
+auto Parser::build(Input& input, Sink& sink) -> PatchTextOutput& {
+    startParse();
+    m_output = buildPchtxt(input, sink, &m_arena, *m_scratch);
+    return m_output;
+}
+
+template <typename Input, typename Sink>
+auto Parser::read(Input& input, PatchTextHandler& handler, Sink& sink) -> bool {
+    startParse();
+    auto reader = makeLineReader(input, *m_scratch);
+    return readPchtxt(reader, handler, sink, *m_scratch);
+}
+
+auto Parser::parse(std::istream& input) -> PatchTextOutput& {
+    auto sink = NullSink{};
+    return build(input, sink);
+}
+
+auto Parser::parse(std::istream& input, std::ostream& logOs) -> PatchTextOutput& {
+    auto sink = OstreamSink{logOs};
+    return parse(input, sink);
+}
+
+auto Parser::parse(std::istream& input, DiagnosticSink& sink) -> PatchTextOutput& { return build(input, sink); }
+
+auto Parser::parse(std::span<const char> input) -> PatchTextOutput& {
+    auto sink = NullSink{};
+    return build(input, sink);
+}
+
+auto Parser::parse(std::span<const char> input, std::ostream& logOs) -> PatchTextOutput& {
+    auto sink = OstreamSink{logOs};
+    return parse(input, sink);
+}
+
+auto Parser::parse(std::span<const char> input, DiagnosticSink& sink) -> PatchTextOutput& {
+    return build(input, sink);
+}
+
+auto Parser::parse(std::istream& input, PatchTextHandler& handler) -> bool {
+    auto sink = NullSink{};
+    return read(input, handler, sink);
+}
+
+auto Parser::parse(std::istream& input, PatchTextHandler& handler, std::ostream& logOs) -> bool {
+    auto sink = OstreamSink{logOs};
+    return parse(input, handler, sink);
+}
+
+auto Parser::parse(std::istream& input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool {
+    return read(input, handler, sink);
+}
+
+auto Parser::parse(std::span<const char> input, PatchTextHandler& handler) -> bool {
+    auto sink = NullSink{};
+    return read(input, handler, sink);
+}
+
+auto Parser::parse(std::span<const char> input, PatchTextHandler& handler, std::ostream& logOs) -> bool {
+    auto sink = OstreamSink{logOs};
+    return parse(input, handler, sink);
+}
+
+auto Parser::parse(std::span<const char> input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool {
+    return read(input, handler, sink);
 }
 
-void writeIps(PatchCollection& patchCollection, std::ostream& ostream) {
-    ostream.write(IPS32_HEADER_MAGIC, std::strlen(IPS32_HEADER_MAGIC));
-    for (auto& patch : patchCollection.patches) {
-        if (patch.type != BIN or patch.enabled == false) continue;
-        for (auto& patchContent : patch.contents) {
-            for (auto rightShift : {3, 2, 1, 0}) {
-                auto byteToWrite = static_cast<char>((patchContent.offset >> rightShift * 8) & 0xFF);
-                ostream.write(&byteToWrite, 1);
+// follows the bid tags the same way readPchtxt does, hashing the lines between them into the collection they belong to
+auto fingerprintCollections(std::span<const char> input) -> std::vector<CollectionFingerprint> {
+    constexpr auto NO_COLLECTION = SIZE_MAX;
+
+    auto result = std::vector<CollectionFingerprint>{};
+    auto byBuildId = std::unordered_map<std::string, size_t>{};
+    auto current = NO_COLLECTION;
+    auto curOffsetShift = std::string_view{};
+    auto curIsBigEndian = false;
+
+    auto reader = SpanLineReader{input};
+    auto sectionStart = input.data();
+    auto endSection = [&](const char* sectionEnd) {
+        if (current == NO_COLLECTION) return;
+        result[current].hash = hashBytes({sectionStart, sectionEnd}, result[current].hash);
+    };
+
+    auto rawLine = std::string_view{};
+    while (reader.next(rawLine)) {
+        // only tags matter, so other lines are not lexed
+        auto lineStart = ltrim(rawLine);
+        if (lineStart.empty() or lineStart[0] != TAG_IDENTIFIER[0]) continue;
+        auto lineNoComment = lexLine(rawLine).noComment;
+        auto curTag = firstToken(lineNoComment);
+        auto tag = lookup(TAGS, curTag);
+
+        if (tag == Tag::STOP_PARSING) {
+            endSection(rawLine.data());
+            current = NO_COLLECTION;
+            break;
+
+        } else if (tag == Tag::FLAG) {
+            auto flagContent = ltrim(lineNoComment.substr(curTag.size()));
+            auto flagType = firstToken(flagContent);
+            auto flagValue = ltrim(flagContent.substr(flagType.size()));
+            auto flag = lookup(FLAGS, flagType);
+
+            if (flag == Flag::BIG_ENDIAN_ORDER or flag == Flag::LITTLE_ENDIAN_ORDER) {
+                curIsBigEndian = flag == Flag::BIG_ENDIAN_ORDER;
+
+            } else if (flag == Flag::OFFSET_SHIFT) {
+                curOffsetShift = flagValue;
+
+            } else if (flag == Flag::NSOBID or flag == Flag::NROBID) {
+                endSection(rawLine.data());
+                auto [collection, isNew] = byBuildId.try_emplace(std::string{flagValue}, result.size());
+                if (isNew) result.push_back({std::string{flagValue}, 0});
+                current = collection->second;
+
+                // the section parses differently if the state it starts in is different
+                auto& hash = result[current].hash;
+                hash = hashBytes(curOffsetShift, hash);
+                hash = hashBytes(std::string_view{curIsBigEndian ? BIG_ENDIAN_FLAG : LITTLE_ENDIAN_FLAG}, hash);
+                sectionStart = rawLine.data() + rawLine.size();
             }
-            for (auto rightShift : {1, 0}) {
-                auto byteToWrite = static_cast<char>((patchContent.value.size() >> rightShift * 8) & 0xFF);
-                ostream.write(&byteToWrite, 1);
+
+        } else if (tag != Tag::ENABLED and tag != Tag::DISABLED and
+                   isStartsWithIgnoreCase(lineNoComment, NSOBID_TAG) and
+                   lineNoComment.size() > std::string_view(NSOBID_TAG).size() + 1) {
+            // legacy style bid, which names the current collection
+            auto buildId = ltrim(lineNoComment.substr(std::string_view(NSOBID_TAG).size() + 1));
+            if (current == NO_COLLECTION) {
+                current = result.size();
+                result.push_back({});
+            } else {
+                auto indexed = byBuildId.find(result[current].buildId);
+                if (indexed != end(byBuildId) and indexed->second == current) byBuildId.erase(indexed);
             }
-            ostream.write(reinterpret_cast<char*>(patchContent.value.data()), patchContent.value.size());
+            result[current].buildId = buildId;
+            byBuildId.try_emplace(std::string{buildId}, current);
         }
     }
-    ostream.write(IPS32_FOOTER_MAGIC, std::strlen(IPS32_FOOTER_MAGIC));
+    endSection(input.data() + input.size());
+
+    return result;
 }
 
 }  // namespace pchtxt
@@ -20,19 +20,49 @@
 
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "arena.hpp"
+#include "small_vector.hpp"
+
 namespace pchtxt {
 
+/**
+ * Allocator used by the patch model. Every type below can be given a std::pmr::memory_resource, which all of its
+ * strings and containers are allocated from
+ */
+using Allocator = std::pmr::polymorphic_allocator<>;
+
 /**
  * The content patches
  */
 struct PatchContent {
-    uint32_t offset;            /*!< The offset to patch at. AMS cheats will have this be 0 */
-    std::vector<uint8_t> value; /*!< The value to be patched, in bytes, or plain text for AMS cheats */
+    using allocator_type = Allocator;
+
+    uint32_t offset = 0;            /*!< The offset to patch at. AMS cheats will have this be 0 */
+    SmallVector<uint8_t, 16> value; /*!< The value to be patched, in bytes, or plain text for AMS cheats. Values of up
+                                         to 16 bytes, such as single instructions, are stored without allocating */
+
+    PatchContent() = default;
+    explicit PatchContent(const allocator_type& alloc) : value(alloc) {}
+    PatchContent(const PatchContent& other) = default;
+    PatchContent(const PatchContent& other, const allocator_type& alloc)
+        : offset(other.offset), value(other.value, alloc) {}
+    PatchContent(PatchContent&& other) = default;
+    PatchContent(PatchContent&& other, const allocator_type& alloc)
+        : offset(other.offset), value(std::move(other.value), alloc) {}
+    auto operator=(const PatchContent& other) -> PatchContent& = default;
+    auto operator=(PatchContent&& other) -> PatchContent& = default;
+
+    auto get_allocator() const -> allocator_type { return value.get_allocator(); }
 };
 
 /**
@@ -44,12 +74,37 @@ enum PatchType { BIN, HEAP, AMS };
  * One patch in the output
  */
 struct Patch {
-    std::string name;                 /*!< Name of the patch */
-    std::string author;               /*!< Author of the patch */
-    PatchType type;                   /*!< Type of the patch */
-    bool enabled;                     /*!< The patch is currently enabled or not */
-    int lineNum;                      /*!< Line number the patch was read from */
-    std::list<PatchContent> contents; /*!< List of contents for the patch */
+    using allocator_type = Allocator;
+
+    std::pmr::string name;                 /*!< Name of the patch */
+    std::pmr::string author;               /*!< Author of the patch */
+    PatchType type = BIN;                  /*!< Type of the patch */
+    bool enabled = false;                  /*!< The patch is currently enabled or not */
+    int lineNum = 0;                       /*!< Line number the patch was read from */
+    std::pmr::list<PatchContent> contents; /*!< List of contents for the patch */
+
+    Patch() = default;
+    explicit Patch(const allocator_type& alloc) : name(alloc), author(alloc), contents(alloc) {}
+    Patch(const Patch& other) = default;
+    Patch(const Patch& other, const allocator_type& alloc)
+        : name(other.name, alloc),
+          author(other.author, alloc),
+          type(other.type),
+          enabled(other.enabled),
+          lineNum(other.lineNum),
+          contents(other.contents, alloc) {}
+    Patch(Patch&& other) = default;
+    Patch(Patch&& other, const allocator_type& alloc)
+        : name(std::move(other.name), alloc),
+          author(std::move(other.author), alloc),
+          type(other.type),
+          enabled(other.enabled),
+          lineNum(other.lineNum),
+          contents(std::move(other.contents), alloc) {}
+    auto operator=(const Patch& other) -> Patch& = default;
+    auto operator=(Patch&& other) -> Patch& = default;
+
+    auto get_allocator() const -> allocator_type { return contents.get_allocator(); }
 };
 
 /**
@@ -61,42 +116,435 @@ enum TargetType { NSO, NRO };
  * Collection of patches for one binary file
  */
 struct PatchCollection {
-    std::string buildId;      /*!< Build ID of the target binary */
-    TargetType targetType;    /*!< Type of the target binary */
-    std::list<Patch> patches; /*!< List of patches to be applied */
+    using allocator_type = Allocator;
+
+    std::pmr::string buildId;      /*!< Build ID of the target binary */
+    TargetType targetType = NSO;   /*!< Type of the target binary */
+    std::pmr::list<Patch> patches; /*!< List of patches to be applied */
+
+    PatchCollection() = default;
+    explicit PatchCollection(const allocator_type& alloc) : buildId(alloc), patches(alloc) {}
+    PatchCollection(const PatchCollection& other) = default;
+    PatchCollection(const PatchCollection& other, const allocator_type& alloc)
+        : buildId(other.buildId, alloc), targetType(other.targetType), patches(other.patches, alloc) {}
+    PatchCollection(PatchCollection&& other) = default;
+    PatchCollection(PatchCollection&& other, const allocator_type& alloc)
+        : buildId(std::move(other.buildId), alloc),
+          targetType(other.targetType),
+          patches(std::move(other.patches), alloc) {}
+    auto operator=(const PatchCollection& other) -> PatchCollection& = default;
+    auto operator=(PatchCollection&& other) -> PatchCollection& = default;
+
+    auto get_allocator() const -> allocator_type { return patches.get_allocator(); }
 };
 
 struct PatchTextMeta {
-    std::string title;     /*!< Title of the Patch Text for description purposes. For example: the game's name */
-    std::string programId; /*!< Program ID, also know as Title ID */
-    std::string url;       /*!< An url that can be used to update the pchtxt with */
+    using allocator_type = Allocator;
+
+    std::pmr::string title;     /*!< Title of the Patch Text for description purposes. For example: the game's name */
+    std::pmr::string programId; /*!< Program ID, also know as Title ID */
+    std::pmr::string url;       /*!< An url that can be used to update the pchtxt with */
+
+    PatchTextMeta() = default;
+    explicit PatchTextMeta(const allocator_type& alloc) : title(alloc), programId(alloc), url(alloc) {}
+    PatchTextMeta(const PatchTextMeta& other) = default;
+    PatchTextMeta(const PatchTextMeta& other, const allocator_type& alloc)
+        : title(other.title, alloc), programId(other.programId, alloc), url(other.url, alloc) {}
+    PatchTextMeta(PatchTextMeta&& other) = default;
+    PatchTextMeta(PatchTextMeta&& other, const allocator_type& alloc)
+        : title(std::move(other.title), alloc),
+          programId(std::move(other.programId), alloc),
+          url(std::move(other.url), alloc) {}
+    auto operator=(const PatchTextMeta& other) -> PatchTextMeta& = default;
+    auto operator=(PatchTextMeta&& other) -> PatchTextMeta& = default;
+
+    auto get_allocator() const -> allocator_type { return title.get_allocator(); }
 };
 
 /**
  * Compiled output for one Patch Text. Can contain outputs for multiple binaries
  */
 struct PatchTextOutput {
-    PatchTextMeta meta;                     /*!< Meta data for the Patch Text file */
-    std::list<PatchCollection> collections; /*!< Patch collections, each collection is intended for one binary */
+    using allocator_type = Allocator;
+
+    PatchTextMeta meta;                          /*!< Meta data for the Patch Text file */
+    std::pmr::list<PatchCollection> collections; /*!< Patch collections, each collection is intended for one binary */
+
+    PatchTextOutput() = default;
+    explicit PatchTextOutput(const allocator_type& alloc) : meta(alloc), collections(alloc) {}
+    PatchTextOutput(const PatchTextOutput& other) = default;
+    PatchTextOutput(const PatchTextOutput& other, const allocator_type& alloc)
+        : meta(other.meta, alloc), collections(other.collections, alloc) {}
+    PatchTextOutput(PatchTextOutput&& other) = default;
+    PatchTextOutput(PatchTextOutput&& other, const allocator_type& alloc)
+        : meta(std::move(other.meta), alloc), collections(std::move(other.collections), alloc) {}
+    auto operator=(const PatchTextOutput& other) -> PatchTextOutput& = default;
+    auto operator=(PatchTextOutput&& other) -> PatchTextOutput& = default;
+
+    auto get_allocator() const -> allocator_type { return collections.get_allocator(); }
+};
+
+/**
+ * How severe a Diagnostic is
+ */
+enum DiagnosticLevel { LEVEL_ERROR, LEVEL_WARNING, LEVEL_INFO, LEVEL_DEBUG };
+
+/**
+ * What a Diagnostic reports. Errors end parsing unless the sink is recovering, debug diagnostics are only reported
+ * once debug info is enabled
+ */
+enum class DiagnosticCode : uint8_t {
+    // errors
+    MISSING_BUILD_ID,         /*!< A patch starts before any build id */
+    MISSING_LEGACY_BUILD_ID,  /*!< A legacy style @nsobid tag has no value */
+    INVALID_OFFSET_SHIFT,     /*!< subject: the offset shift, which is not a number or does not fit in an int */
+    OFFSET_OUT_OF_RANGE,      /*!< subject: the offset, which does not fit in 32 bits */
+    UNTERMINATED_STRING,      /*!< subject: the string value without a closing quotation mark */
+    BAD_HEX_LENGTH,           /*!< subject: the hex value with an odd number of digits */
+    BAD_HEX_VALUE,            /*!< subject: the hex value, column: where its bad character is */
+    // warnings
+    UNKNOWN_FLAG,             /*!< subject: the flag type that was ignored */
+    UNKNOWN_TAG,              /*!< subject: the tag that was ignored */
+    // info
+    ECHO,                     /*!< subject: the echoed line */
+    META_TITLE,               /*!< subject: the title */
+    META_PROGRAM_ID,          /*!< subject: the program id */
+    META_URL,                 /*!< subject: the url */
+    LEGACY_TITLE,             /*!< subject: the legacy style title, used as there is no @title */
+    META_DONE,                /*!< The meta ends at an empty line */
+    META_STOPPED,             /*!< The meta ends at @stop */
+    META_END_OF_FILE,         /*!< The meta ends at the end of the Patch Text */
+    DEBUG_INFO_ENABLED,       /*!< A debug_info flag enables debug diagnostics */
+    PATCH_READ,               /*!< subject: the name of the patch, which had contents */
+    PARSING_STOPPED,          /*!< Parsing ends at @stop */
+    PARSING_DONE,             /*!< Parsing reaches the end of the Patch Text */
+    // debug
+    COLLECTION_START,         /*!< subject: the build id */
+    LEGACY_COLLECTION_START,  /*!< subject: the legacy style build id */
+    COLLECTION_STOP,          /*!< subject: the build id, left for another one */
+    COLLECTION_DONE,          /*!< subject: the build id, at the end of the Patch Text */
+    OFFSET_SHIFT,             /*!< value: the new offset shift */
+    PATCH_START,              /*!< subject: the name of the patch */
+    AMS_CHEAT_START,          /*!< subject: the name of the cheat */
+    AMS_CHEAT_CONTENT,        /*!< subject: the line of the cheat */
+    CONTENT,                  /*!< value: the offset, bytes: the value */
+    LINE_IGNORED,             /*!< subject: the line, which does not start with a hex offset */
+};
+
+/**
+ * One thing the parser has to report, as fields. Views and spans point into the parser's buffers and are only valid
+ * during DiagnosticSink::report
+ */
+struct Diagnostic {
+    DiagnosticLevel level = LEVEL_INFO;
+    DiagnosticCode code = DiagnosticCode::ECHO;
+    int lineNum = 0;                     /*!< Line the diagnostic is about */
+    int column = 0;                      /*!< Column in the line, starting at 1, or 0 if it is about the whole line */
+    std::string_view subject = {};       /*!< What the diagnostic is about, see DiagnosticCode */
+    int64_t value = 0;                   /*!< A number the diagnostic reports, see DiagnosticCode */
+    std::span<const uint8_t> bytes = {}; /*!< Bytes the diagnostic reports, see DiagnosticCode */
+};
+
+/**
+ * Write a diagnostic as the text of a parsing log line, without the line break
+ */
+auto operator<<(std::ostream& os, const Diagnostic& diagnostic) -> std::ostream&;
+
+/**
+ * Name of a diagnostic code or level for machine readable output, such as "bad_hex_value" or "error"
+ */
+auto getDiagnosticCodeName(DiagnosticCode code) -> std::string_view;
+auto getDiagnosticLevelName(DiagnosticLevel level) -> std::string_view;
+
+/**
+ * Receives the diagnostics of a parse
+ */
+class DiagnosticSink {
+   public:
+    virtual ~DiagnosticSink() = default;
+
+    virtual void report(const Diagnostic& diagnostic) = 0;
+
+    /**
+     * If parsing goes on after an error, skipping the line it is in, or the whole patch for a missing build id. The
+     * parse then returns everything else it could read
+     */
+    virtual auto isRecovering() const -> bool { return false; }
+};
+
+/**
+ * Drops every diagnostic. Parsing without a sink uses it in a way that removes reporting from the parser entirely
+ */
+class NullSink final : public DiagnosticSink {
+   public:
+    void report(const Diagnostic&) override {}
+};
+
+/**
+ * Writes every diagnostic as a parsing log line to an ostream, without flushing it
+ */
+class OstreamSink final : public DiagnosticSink {
+   public:
+    explicit OstreamSink(std::ostream& os) : m_os(os) {}
+
+    void report(const Diagnostic& diagnostic) override { m_os << diagnostic << '\n'; }
+
+   private:
+    std::ostream& m_os;
+};
+
+/**
+ * A Diagnostic as DiagnosticCollector keeps it, with its message
+ */
+struct CollectedDiagnostic {
+    DiagnosticLevel level;
+    DiagnosticCode code;
+    int lineNum;         /*!< Line the diagnostic is about */
+    int column;          /*!< Column in the line, starting at 1, or 0 if it is about the whole line */
+    std::string message; /*!< The parsing log line of the diagnostic, without its line number */
+};
+
+/**
+ * Keeps the diagnostics of a parse, by default recovering from errors to collect all of them in a single parse
+ */
+class DiagnosticCollector final : public DiagnosticSink {
+   public:
+    /**
+     * @param maxLevel [optional] the least severe level of diagnostics to keep
+     * @param isRecovering [optional] if parsing goes on after an error
+     */
+    explicit DiagnosticCollector(DiagnosticLevel maxLevel = LEVEL_WARNING, bool isRecovering = true)
+        : m_maxLevel(maxLevel), m_isRecovering(isRecovering) {}
+
+    void report(const Diagnostic& diagnostic) override;
+
+    auto isRecovering() const -> bool override { return m_isRecovering; }
+
+    auto diagnostics() const -> const std::vector<CollectedDiagnostic>& { return m_diagnostics; }
+
+    auto errorCount() const -> size_t { return m_errorCount; }
+
+    /**
+     * Drop the diagnostics collected so far, to collect those of another parse
+     */
+    void clear() {
+        m_diagnostics.clear();
+        m_errorCount = 0;
+    }
+
+   private:
+    DiagnosticLevel m_maxLevel;
+    bool m_isRecovering;
+    std::vector<CollectedDiagnostic> m_diagnostics;
+    size_t m_errorCount = 0;
 };
 
 /**
  * Compile a complete output from one Patch Text
  * @param input an istream from the pchtxt file
- * @param logOs [optional] an ostream to capture parsing logs
+ * @param logOs [optional] an ostream to capture parsing logs, or a DiagnosticSink to receive them as diagnostics
+ * @param memoryResource [optional] the memory resource to allocate the output from, for example an arena that is
+ * released once the output is no longer needed
+ * @return The PatchTextOutput struct containing all the parsed information from the Patch Text
+ */
+auto parsePchtxt(std::istream& input, std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource())
+    -> PatchTextOutput;
+auto parsePchtxt(std::istream& input, std::ostream& logOs,
+                 std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) -> PatchTextOutput;
+auto parsePchtxt(std::istream& input, DiagnosticSink& sink,
+                 std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) -> PatchTextOutput;
+
+/**
+ * Compile a complete output from one Patch Text already in memory, such as a memory mapped file
+ * @param input the content of the pchtxt file
+ * @param logOs [optional] an ostream to capture parsing logs, or a DiagnosticSink to receive them as diagnostics
+ * @param memoryResource [optional] the memory resource to allocate the output from
  * @return The PatchTextOutput struct containing all the parsed information from the Patch Text
  */
-inline auto parsePchtxt(std::istream& input) -> PatchTextOutput;
-auto parsePchtxt(std::istream& input, std::ostream& logOs) -> PatchTextOutput;
+auto parsePchtxt(std::span<const char> input,
+                 std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) -> PatchTextOutput;
+auto parsePchtxt(std::span<const char> input, std::ostream& logOs,
+                 std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) -> PatchTextOutput;
+auto parsePchtxt(std::span<const char> input, DiagnosticSink& sink,
+                 std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) -> PatchTextOutput;
+
+/**
+ * Runs func(index) for every index below count, in any order and on any threads, and returns once all of them ran
+ */
+using ParallelFor = std::function<void(size_t count, const std::function<void(size_t index)>& func)>;
+
+/**
+ * Compile a complete output from one Patch Text in memory, parsing it in chunks that start at bid flags in parallel.
+ * Offset shift, byte order and the last comment are carried into each chunk, and the collections are merged in order,
+ * so the output and logs are the same as parsePchtxt's. Small Patch Texts, and ones with debug info enabled, are
+ * parsed in one pass
+ * @param input the content of the pchtxt file
+ * @param logOs an ostream to capture parsing logs
+ * @param parallelFor runs the chunks
+ * @param memoryResource [optional] the memory resource to allocate the output from. It is only used by the calling
+ * thread, as the chunks allocate from arenas of their own, unless it is std::pmr::new_delete_resource()
+ * @return The PatchTextOutput struct containing all the parsed information from the Patch Text
+ */
+auto parsePchtxt(std::span<const char> input, std::ostream& logOs, const ParallelFor& parallelFor,
+                 std::pmr::memory_resource* memoryResource = std::pmr::get_default_resource()) -> PatchTextOutput;
+
+/**
+ * Basic information of a patch, passed to a PatchTextHandler before its contents
+ */
+struct PatchHeader {
+    std::string_view name;   /*!< Name of the patch */
+    std::string_view author; /*!< Author of the patch */
+    PatchType type;          /*!< Type of the patch */
+    bool enabled;            /*!< The patch is currently enabled or not */
+    int lineNum;             /*!< Line number the patch was read from */
+};
+
+/**
+ * Receives the parts of a Patch Text as they are parsed, instead of a whole PatchTextOutput at the end. Every
+ * callback does nothing by default, so a handler only overrides the ones it needs. Views and spans point into the
+ * parser's buffers and are only valid during the call
+ */
+class PatchTextHandler {
+   public:
+    virtual ~PatchTextHandler() = default;
+
+    /**
+     * The meta data is complete, at the first empty line or at the end of the Patch Text
+     */
+    virtual void onMeta(const PatchTextMeta& /*meta*/) {}
+
+    /**
+     * Patches that follow are for the binary with this build id. A build id can start again later in the Patch Text,
+     * to add more patches to the same collection
+     */
+    virtual void onCollectionStart(std::string_view /*buildId*/, TargetType /*targetType*/) {}
+
+    /**
+     * Legacy style build id, which names the current collection, or starts an NSO one if there is none. The output
+     * merges the collection into an earlier one with the same build id
+     */
+    virtual void onCollectionRename(std::string_view /*buildId*/) {}
+
+    /**
+     * The current collection is left, for another build id or at the end of the Patch Text
+     */
+    virtual void onCollectionEnd() {}
+
+    virtual void onPatchStart(const PatchHeader& /*patchHeader*/) {}
+
+    /**
+     * One content of the current patch, with the offset shift already applied. AMS cheats have an offset of 0 and the
+     * line as plain text for value
+     */
+    virtual void onContent(uint32_t /*offset*/, std::span<const uint8_t> /*value*/) {}
+
+    /**
+     * Every onPatchStart is followed by one onPatchEnd. parsePchtxt only keeps the patches that had contents
+     */
+    virtual void onPatchEnd() {}
+};
+
+/**
+ * Parse a Patch Text, passing its parts to a handler as they are read. Memory use does not grow with the size of the
+ * Patch Text, apart from a few bytes for each build id
+ * @param input an istream from the pchtxt file, or the content of the pchtxt file in memory
+ * @param handler the PatchTextHandler to pass the parts of the Patch Text to
+ * @param logOs [optional] an ostream to capture parsing logs, or a DiagnosticSink to receive them as diagnostics
+ * @return If the whole Patch Text was parsed. On an error, parsing stops without further calls to the handler, unless
+ * the sink is recovering
+ */
+auto parsePchtxt(std::istream& input, PatchTextHandler& handler) -> bool;
+auto parsePchtxt(std::istream& input, PatchTextHandler& handler, std::ostream& logOs) -> bool;
+auto parsePchtxt(std::istream& input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool;
+auto parsePchtxt(std::span<const char> input, PatchTextHandler& handler) -> bool;
+auto parsePchtxt(std::span<const char> input, PatchTextHandler& handler, std::ostream& logOs) -> bool;
+auto parsePchtxt(std::span<const char> input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool;
+
+struct ParseScratch;
+
+/**
+ * Parses Patch Text after Patch Text with the same buffers, for workers that go through many of them. The output is
+ * allocated from the parser's arena, which is reused by the next parse, so it is only valid until then. Once the
+ * buffers and the arena have grown to fit the largest Patch Text, parsing does not allocate at all, apart from what
+ * the sink allocates
+ */
+class Parser {
+   public:
+    Parser();
+    ~Parser();
+
+    Parser(const Parser&) = delete;
+    auto operator=(const Parser&) -> Parser& = delete;
+
+    /**
+     * Compile a complete output from one Patch Text, the same as parsePchtxt
+     * @param input an istream from the pchtxt file, or the content of the pchtxt file in memory
+     * @param logOs [optional] an ostream to capture parsing logs, or a DiagnosticSink to receive them as diagnostics
+     * @return The PatchTextOutput struct containing all the parsed information from the Patch Text, valid until the
+     * next parse
+     */
+    auto parse(std::istream& input) -> PatchTextOutput&;
+    auto parse(std::istream& input, std::ostream& logOs) -> PatchTextOutput&;
+    auto parse(std::istream& input, DiagnosticSink& sink) -> PatchTextOutput&;
+    auto parse(std::span<const char> input) -> PatchTextOutput&;
+    auto parse(std::span<const char> input, std::ostream& logOs) -> PatchTextOutput&;
+    auto parse(std::span<const char> input, DiagnosticSink& sink) -> PatchTextOutput&;
+
+    /**
+     * Parse a Patch Text, passing its parts to a handler as they are read, the same as parsePchtxt
+     * @param input an istream from the pchtxt file, or the content of the pchtxt file in memory
+     * @param handler the PatchTextHandler to pass the parts of the Patch Text to
+     * @param logOs [optional] an ostream to capture parsing logs, or a DiagnosticSink to receive them as diagnostics
+     * @return If the whole Patch Text was parsed
+     */
+    auto parse(std::istream& input, PatchTextHandler& handler) -> bool;
+    auto parse(std::istream& input, PatchTextHandler& handler, std::ostream& logOs) -> bool;
+    auto parse(std::istream& input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool;
+    auto parse(std::span<const char> input, PatchTextHandler& handler) -> bool;
+    auto parse(std::span<const char> input, PatchTextHandler& handler, std::ostream& logOs) -> bool;
+    auto parse(std::span<const char> input, PatchTextHandler& handler, DiagnosticSink& sink) -> bool;
+
+   private:
+    void startParse();
+    template <typename Input, typename Sink>
+    auto build(Input& input, Sink& sink) -> PatchTextOutput&;
+    template <typename Input, typename Sink>
+    auto read(Input& input, PatchTextHandler& handler, Sink& sink) -> bool;
+
+    Arena m_arena;
+    PatchTextOutput m_output;
+    std::unique_ptr<ParseScratch> m_scratch;
+};
 
 /**
  * Parse the meta data for the Patch Text
- * @param input an istream from the pchtxt file
+ * @param input an istream from the pchtxt file, or the content of the pchtxt file in memory
  * @param logOs [optional] an ostream to capture parsing logs
  * @return The PatchTextMeta struct containing the meta information of the Patch Text
  */
 auto getPchtxtMeta(std::istream& input) -> PatchTextMeta;
 auto getPchtxtMeta(std::istream& input, std::ostream& logOs) -> PatchTextMeta;
+auto getPchtxtMeta(std::span<const char> input) -> PatchTextMeta;
+auto getPchtxtMeta(std::span<const char> input, std::ostream& logOs) -> PatchTextMeta;
+
+/**
+ * Fingerprint of the source of one collection
+ */
+struct CollectionFingerprint {
+    std::string buildId; /*!< Build ID of the collection */
+    uint64_t hash;       /*!< Hash of every line the collection is parsed from, and of the offset shift and byte
+                              order in effect where each of its sections starts */
+};
+
+/**
+ * Fingerprint every collection of a Patch Text without parsing its patches. A collection whose fingerprint did not
+ * change since an earlier version of the Patch Text parses to the same patches, apart from their line numbers and
+ * names taken from comments before its sections
+ * @param input the content of the pchtxt file
+ * @return Fingerprints in the order the collections start in the Patch Text. Collections left without patches by
+ * parsePchtxt are included
+ */
+auto fingerprintCollections(std::span<const char> input) -> std::vector<CollectionFingerprint>;
 
 /**
  * Using PatchTextOutput to update the pchtxt content inside an iostream. PatchTextOutput must be originally parsed
@@ -118,10 +566,101 @@ auto updatePchtxt(PatchTextOutput& patchTextOutput, std::iostream& pchtxtUpdateT
 auto convertPatchToAms(Patch& patchToConvert) -> bool;
 
 /**
- * Write an IPS file with BIN patches to an ostream
+ * Format of the IPS output
+ */
+enum IpsFormat { IPS32, IPS, IPS_AUTO };
+
+/**
+ * Options for the IPS output
+ */
+struct IpsOptions {
+    IpsFormat format = IPS32;      /*!< IPS32 with 4 byte offsets, classic IPS with 3 byte offsets, which can only
+                                        patch the first 16 MiB, or IPS_AUTO for whichever of the two is smaller */
+    bool optimize = false;         /*!< Sort the records by offset and merge adjacent and overlapping ones, splitting
+                                        them at the record size limit. Where contents overlap, the one that comes last
+                                        in the Patch Text is kept */
+    size_t rleMinRunSize = 0;      /*!< Runs of at least this many repeated bytes are written as RLE records, where
+                                        that makes the file smaller. 0 writes no RLE records */
+    std::ostream* logOs = nullptr; /*!< [optional] an ostream to report contents overwritten by optimize, and why the
+                                        IPS file could not be written, to */
+};
+
+/**
+ * Get the exact size of the IPS file that writeIps produces for a collection
+ * @param patchCollection the PatchCollection for one binary file
+ * @param options [optional] how to write the IPS file
+ * @return Size of the IPS file in bytes, or 0 if it cannot be written in the requested format
+ */
+auto getIpsSize(const PatchCollection& patchCollection, const IpsOptions& options = {}) -> size_t;
+
+/**
+ * Write an IPS file with BIN patches into a buffer
+ * @param patchCollection the PatchCollection for one binary file
+ * @param buffer the buffer to write the IPS file to, at least getIpsSize bytes long
+ * @param options [optional] how to write the IPS file
+ * @return How many bytes were written, or 0 if the buffer is too small or the IPS file cannot be written
+ */
+auto writeIps(const PatchCollection& patchCollection, std::span<uint8_t> buffer, const IpsOptions& options = {})
+    -> size_t;
+
+/**
+ * Build an IPS file with BIN patches in memory
+ * @param patchCollection the PatchCollection for one binary file
+ * @param options [optional] how to write the IPS file
+ * @return The content of the IPS file, empty if it cannot be written in the requested format
+ */
+auto getIps(const PatchCollection& patchCollection, const IpsOptions& options = {}) -> std::vector<uint8_t>;
+
+/**
+ * Write an IPS file with BIN patches to an ostream, in a single write. Nothing is written if the IPS file cannot be
+ * written in the requested format
  * @param patchCollection the PatchCollection for one binary file
  * @param ostream the ostream to write the IPS file to
+ * @param options [optional] how to write the IPS file
  */
-void writeIps(PatchCollection& patchCollection, std::ostream& ostream);
+void writeIps(const PatchCollection& patchCollection, std::ostream& ostream, const IpsOptions& options = {});
+
+/**
+ * Writes an IPS32 file while the contents of its collection are still being read, such as from a PatchTextHandler,
+ * without keeping the collection in memory. Records are written as they are added, apart from one that ends at the
+ * IPS32 footer offset, which is held until the next one is added. The file is the same as the one writeIps writes with
+ * the default options
+ */
+class IpsStreamWriter {
+   public:
+    /**
+     * @param ostream the ostream to write the IPS file to. The header is written right away
+     */
+    explicit IpsStreamWriter(std::ostream& ostream);
+
+    /**
+     * Add one content of an enabled BIN patch, in the order of the Patch Text
+     * @param offset the offset to patch at
+     * @param value the value to be patched
+     */
+    void addContent(uint32_t offset, std::span<const uint8_t> value);
+
+    /**
+     * Write the held record and the footer
+     * @param logOs [optional] an ostream to report why the IPS file could not be written to
+     * @return If the IPS file was written. If not, the output so far is not a valid IPS file and should be discarded
+     */
+    auto finish(std::ostream* logOs = nullptr) -> bool;
+
+   private:
+    enum class Problem { NONE, RECORD_AT_FOOTER, PAST_LAST_OFFSET };
+
+    void addRecord(uint32_t offset, std::span<const uint8_t> value);
+    void writeHeldRecord();
+    void writeRecord(uint32_t offset, std::span<const uint8_t> head, std::span<const uint8_t> tail);
+
+    std::ostream& m_ostream;
+    uint32_t m_heldOffset = 0;          /*!< Offset of the held record */
+    std::vector<uint8_t> m_heldRecord;  /*!< The last record if it ends at the footer offset, held back in case the
+                                             next one starts there and has to take over its last byte */
+    Problem m_problem = Problem::NONE;  /*!< Why the IPS file cannot be written. Nothing more is written after one */
+    uint32_t m_problemOffset = 0;       /*!< Offset of the content that runs past the last offset */
+    size_t m_problemSize = 0;           /*!< Size of the content that runs past the last offset */
+};
 
 }  // namespace pchtxt
@@ -0,0 +1,181 @@
+/**
+ * @file small_vector.hpp
+ * @brief Vector with inline storage for short values
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <stdexcept>
+#include <type_traits>
+
+namespace pchtxt {
+
+/**
+ * A vector of trivially copyable elements that keeps up to N of them inline and only allocates, from its memory
+ * resource, once it grows past that. Follows the std::pmr container rules for which resource is used on copy and move.
+ * Sizes are kept in 32 bits, growing past max_size() throws std::length_error
+ */
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable_v<T>, "SmallVector only holds trivially copyable elements");
+
+   public:
+    using value_type = T;
+    using size_type = size_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using iterator = T*;
+    using const_iterator = const T*;
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+
+    SmallVector() = default;
+    explicit SmallVector(const allocator_type& alloc) : m_resource(alloc.resource()) {}
+
+    template <typename InputIt>
+    SmallVector(InputIt first, InputIt last, const allocator_type& alloc = {}) : m_resource(alloc.resource()) {
+        assign(first, last);
+    }
+
+    SmallVector(const SmallVector& other) : SmallVector(other, allocator_type{}) {}
+    SmallVector(const SmallVector& other, const allocator_type& alloc) : m_resource(alloc.resource()) {
+        assign(other.begin(), other.end());
+    }
+
+    SmallVector(SmallVector&& other) noexcept : m_resource(other.m_resource) { steal(other); }
+    SmallVector(SmallVector&& other, const allocator_type& alloc) : m_resource(alloc.resource()) {
+        if (*m_resource == *other.m_resource) {
+            steal(other);
+        } else {
+            assign(other.begin(), other.end());
+        }
+    }
+
+    ~SmallVector() { deallocate(); }
+
+    auto operator=(const SmallVector& other) -> SmallVector& {
+        if (this != &other) assign(other.begin(), other.end());
+        return *this;
+    }
+
+    auto operator=(SmallVector&& other) -> SmallVector& {
+        if (this == &other) return *this;
+        if (*m_resource == *other.m_resource) {
+            deallocate();
+            steal(other);
+        } else {
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    auto get_allocator() const -> allocator_type { return m_resource; }
+
+    auto data() -> T* { return m_data; }
+    auto data() const -> const T* { return m_data; }
+    auto size() const -> size_type { return m_size; }
+    auto capacity() const -> size_type { return m_capacity; }
+    auto max_size() const -> size_type { return UINT32_MAX; }
+    auto empty() const -> bool { return m_size == 0; }
+    auto isInline() const -> bool { return m_data == m_inline; }
+
+    auto begin() -> iterator { return m_data; }
+    auto begin() const -> const_iterator { return m_data; }
+    auto end() -> iterator { return m_data + m_size; }
+    auto end() const -> const_iterator { return m_data + m_size; }
+
+    auto operator[](size_type pos) -> reference { return m_data[pos]; }
+    auto operator[](size_type pos) const -> const_reference { return m_data[pos]; }
+    auto front() -> reference { return m_data[0]; }
+    auto front() const -> const_reference { return m_data[0]; }
+    auto back() -> reference { return m_data[m_size - 1]; }
+    auto back() const -> const_reference { return m_data[m_size - 1]; }
+
+    void reserve(size_type newCapacity) {
+        if (newCapacity <= m_capacity) return;
+        if (newCapacity > max_size()) throw std::length_error("SmallVector grown past max_size()");
+        auto* newData = static_cast<T*>(m_resource->allocate(newCapacity * sizeof(T), alignof(T)));
+        if (m_size > 0) std::memcpy(newData, m_data, m_size * sizeof(T));
+        deallocate();
+        m_data = newData;
+        m_capacity = newCapacity;
+    }
+
+    void resize(size_type newSize) {
+        if (newSize > m_capacity) grow(newSize);
+        if (newSize > m_size) std::fill(m_data + m_size, m_data + newSize, T{});
+        m_size = newSize;
+    }
+
+    void push_back(const T& value) {
+        if (m_size == m_capacity) grow(m_size + size_type{1});
+        m_data[m_size++] = value;
+    }
+
+    void clear() { m_size = 0; }
+
+    template <typename InputIt>
+    void assign(InputIt first, InputIt last) {
+        clear();
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                        typename std::iterator_traits<InputIt>::iterator_category>) {
+            reserve(std::distance(first, last));
+        }
+        for (; first != last; ++first) push_back(static_cast<T>(*first));
+    }
+
+    friend auto operator==(const SmallVector& lhs, const SmallVector& rhs) -> bool {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    }
+
+   private:
+    // reserves at least minCapacity, doubling the capacity as long as that stays within max_size()
+    void grow(size_type minCapacity) {
+        reserve(std::max(minCapacity, std::min(m_capacity * size_type{2}, max_size())));
+    }
+
+    void deallocate() {
+        if (not isInline()) m_resource->deallocate(m_data, m_capacity * sizeof(T), alignof(T));
+        m_data = m_inline;
+        m_capacity = N;
+    }
+
+    // takes over other's heap buffer, or copies its inline elements, leaving other empty
+    void steal(SmallVector& other) {
+        if (other.isInline()) {
+            std::memcpy(m_inline, other.m_inline, other.m_size * sizeof(T));
+        } else {
+            m_data = other.m_data;
+            m_capacity = other.m_capacity;
+            other.m_data = other.m_inline;
+            other.m_capacity = N;
+        }
+        m_size = other.m_size;
+        other.m_size = 0;
+    }
+
+    T* m_data = m_inline;
+    uint32_t m_size = 0;
+    uint32_t m_capacity = N;
+    std::pmr::memory_resource* m_resource = std::pmr::get_default_resource();
+    T m_inline[N];
+};
+
+}  // namespace pchtxt
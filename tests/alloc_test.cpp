@@ -0,0 +1,81 @@
+/*
+ * Counts the allocations of parsing a fixed Patch Text and writing its IPS file. Patches and collections are moved
+ * through the pipeline, so a copy of the patch model showing up again doubles the count and fails here.
+ */
+
+#include <cstdlib>
+#include <new>
+#include <span>
+#include <string>
+#include "../pchtxt/pchtxt.hpp"
+#include "check.hpp"
+
+static size_t allocationCount = 0;
+static bool isCounting = false;
+
+void *operator new(size_t size) {
+    if (isCounting) allocationCount++;
+    if (void *p = std::malloc(size > 0 ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+/* std::pmr::new_delete_resource, the default memory resource, allocates with an alignment */
+void *operator new(size_t size, std::align_val_t alignment) {
+    if (isCounting) allocationCount++;
+    auto align = static_cast<size_t>(alignment);
+    if (void *p = std::aligned_alloc(align, (size + align - 1) / align * align)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+/* Allocations made by func. */
+template <typename Func>
+size_t countAllocations(Func &&func) {
+    allocationCount = 0;
+    isCounting = true;
+    func();
+    isCounting = false;
+    return allocationCount;
+}
+
+constexpr size_t PATCH_COUNT = 1000;
+
+/* Patches with names too long to be stored inline and two short values each, which are. */
+std::string makePchtxt() {
+    std::string pchtxt = "@flag nsobid 0123456789ABCDEF0123456789ABCDEF\n\n";
+    for (size_t i = 0; i < PATCH_COUNT; i++) {
+        pchtxt += "// Patch number " + std::to_string(i) + " with a long name [someone]\n@enabled\n";
+        pchtxt += std::to_string(10000000 + i * 8) + " 1F2003D5\n" + std::to_string(20000000 + i * 8) + " C0035FD6\n\n";
+    }
+    return pchtxt;
+}
+
+int main() {
+    auto pchtxt = makePchtxt();
+
+    /* a patch allocates its list node, its name and the list nodes of its two contents, and nothing more */
+    pchtxt::PatchTextOutput out;
+    auto parseCount = countAllocations([&] { out = pchtxt::parsePchtxt(std::span<const char>(pchtxt)); });
+    CHECK(out.collections.size() == 1);
+    CHECK(out.collections.front().patches.size() == PATCH_COUNT);
+    CHECK(parseCount >= PATCH_COUNT * 4);
+    CHECK(parseCount <= PATCH_COUNT * 4 + 32);
+
+    /* the IPS file is planned from views into the collection, without copying it */
+    std::vector<uint8_t> ips;
+    auto ipsCount = countAllocations([&] { ips = pchtxt::getIps(out.collections.front(), {}); });
+    CHECK(ips.size() == 5 + PATCH_COUNT * 2 * (4 + 2 + 4) + 4);
+    CHECK(ipsCount <= 64);
+
+    /* once its buffers have grown, a reused Parser no longer allocates at all */
+    pchtxt::Parser parser;
+    parser.parse(std::span<const char>(pchtxt));
+    auto reparseCount = countAllocations([&] { parser.parse(std::span<const char>(pchtxt)); });
+    CHECK(reparseCount == 0);
+
+    return checkResult("alloc_test");
+}
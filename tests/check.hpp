@@ -0,0 +1,24 @@
+#pragma once
+
+#include <iostream>
+
+/* Failed checks are reported and counted without stopping the test, so one run shows all of them. */
+inline int failedCheckCount = 0;
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if (!(condition)) {                                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            failedCheckCount++;                                                                 \
+        }                                                                                       \
+    } while (false)
+
+/* What main returns: 0 if every check passed. */
+inline int checkResult(const char *testName) {
+    if (failedCheckCount > 0) {
+        std::cerr << testName << ": " << failedCheckCount << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << testName << ": passed" << std::endl;
+    return 0;
+}
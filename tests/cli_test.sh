@@ -0,0 +1,51 @@
+#!/bin/sh
+# Converts a pchtxt read from a regular file, a pipe, a FIFO and stdin, and checks that each writes the same ips file.
+# usage: cli_test.sh <path to pchtxt2ips>
+
+program=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+cat > test.pchtxt <<'PCHTXT'
+@title Pipe Test
+
+@flag nsobid 0123456789ABCDEF0123456789ABCDEF
+// Patch [someone]
+@enabled
+00001000 1F2003D5 C0035FD6
+00002000 "text"
+PCHTXT
+bid=0123456789ABCDEF0123456789ABCDEF
+
+failed=0
+check() {
+    if ! cmp -s expected.ips "$bid.ips"; then
+        echo "cli_test: $1 did not write the same ips file" >&2
+        failed=1
+    fi
+    rm -f "$bid.ips"
+}
+
+"$program" test.pchtxt > /dev/null || exit 1
+mv "$bid.ips" expected.ips
+
+cat test.pchtxt | "$program" /dev/stdin > /dev/null
+check "a pipe"
+
+mkfifo fifo
+cat test.pchtxt > fifo &
+"$program" fifo > /dev/null
+wait
+check "a FIFO"
+
+"$program" - < test.pchtxt > /dev/null
+check "stdin"
+
+cat test.pchtxt | "$program" --check /dev/stdin | grep -q '"diagnostics": \[\]' || {
+    echo "cli_test: --check did not read a pipe" >&2
+    failed=1
+}
+
+if [ $failed -ne 0 ]; then exit 1; fi
+echo "cli_test: passed"
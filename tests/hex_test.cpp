@@ -0,0 +1,147 @@
+/*
+ * Checks every hex decoding kernel the CPU supports against the scalar one, on tokens of every length up to past
+ * three 32 character blocks so the tails on either side of the 16 and 32 character widths are covered, and checks
+ * the scalar kernel and the parser's columns against plain expectations.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include "../pchtxt/hex.hpp"
+#include "../pchtxt/pchtxt.hpp"
+#include "check.hpp"
+
+constexpr size_t MAX_TOKEN_SIZE = 100;
+
+/* Characters just outside the ranges the kernels compare against, and ones that only look valid without bit 7. */
+constexpr char BAD_CHARS[] = {'/', ':', '@', 'G', '`', 'g', ' ', '\0', '\xB0', '\xC1', '\xE1', '\xFF'};
+
+static std::mt19937 randomEngine(0x11235813);
+
+/* Mixed case hex digits. */
+std::string makeToken(size_t size) {
+    constexpr char DIGITS[] = "0123456789abcdefABCDEF";
+    std::string token(size, '0');
+    for (auto &ch : token) ch = DIGITS[randomEngine() % (sizeof(DIGITS) - 1)];
+    return token;
+}
+
+int nibble(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return ch - 'A' + 10;
+}
+
+/* The bytes of a valid token, in the order they are written. */
+std::vector<uint8_t> decodeExpected(const std::string &token, bool isBigEndian) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < token.size(); i += 2) bytes.push_back(nibble(token[i]) << 4 | nibble(token[i + 1]));
+    if (isBigEndian) std::reverse(bytes.begin(), bytes.end());
+    return bytes;
+}
+
+/* Decodes into a buffer with guard bytes after the output, which no kernel may write to. */
+bool decodesTo(pchtxt::HexKernel kernel, const std::string &token, bool isBigEndian, size_t expectedPos,
+               const std::vector<uint8_t> *expectedBytes) {
+    constexpr uint8_t GUARD = 0xA5;
+    std::vector<uint8_t> out(token.size() / 2 + 32, GUARD);
+    if (pchtxt::decodeHex(kernel, token, out.data(), isBigEndian) != expectedPos) return false;
+    if (!std::all_of(out.begin() + token.size() / 2, out.end(), [](uint8_t byte) { return byte == GUARD; })) {
+        return false;
+    }
+    return !expectedBytes || std::equal(expectedBytes->begin(), expectedBytes->end(), out.begin());
+}
+
+/* The value of a one line patch, parsed after the given flags. */
+std::vector<uint8_t> parseValue(const std::string &flags, const std::string &line) {
+    auto pchtxt = "@flag nsobid 0123456789ABCDEF0123456789ABCDEF\n" + flags + "\n// Patch\n@enabled\n" + line + "\n";
+    auto out = pchtxt::parsePchtxt(std::span<const char>(pchtxt));
+    if (out.collections.empty()) return {};
+    auto &value = out.collections.front().patches.front().contents.front().value;
+    return std::vector<uint8_t>(value.begin(), value.end());
+}
+
+/* Column of the bad hex value reported for a line, or 0 if there is none. */
+int getBadHexColumn(const std::string &line) {
+    auto pchtxt = "@flag nsobid 0123456789ABCDEF0123456789ABCDEF\n\n// Patch\n@enabled\n" + line + "\n";
+    pchtxt::DiagnosticCollector collector;
+    pchtxt::parsePchtxt(std::span<const char>(pchtxt), collector);
+    for (auto &diagnostic : collector.diagnostics()) {
+        if (diagnostic.code == pchtxt::DiagnosticCode::BAD_HEX_VALUE) return diagnostic.column;
+    }
+    return 0;
+}
+
+int main() {
+    std::vector<pchtxt::HexKernel> kernels;
+    for (auto kernel : {pchtxt::HexKernel::SCALAR, pchtxt::HexKernel::SSE41, pchtxt::HexKernel::AVX2}) {
+        if (pchtxt::isHexKernelSupported(kernel)) kernels.push_back(kernel);
+    }
+    CHECK(kernels.front() == pchtxt::HexKernel::SCALAR);
+    std::cout << "hex_test: checking " << kernels.size() << " kernels" << std::endl;
+
+    for (auto kernel : kernels) {
+        for (bool isBigEndian : {false, true}) {
+            /* every length, odd ones included, whose last character is not read */
+            for (size_t size = 0; size <= MAX_TOKEN_SIZE; size++) {
+                auto token = makeToken(size);
+                auto expected = decodeExpected(token, isBigEndian);
+                CHECK(decodesTo(kernel, token, isBigEndian, std::string::npos, &expected));
+                if (size % 2 != 0) {
+                    token.back() = 'x';
+                    CHECK(decodesTo(kernel, token, isBigEndian, std::string::npos, &expected));
+                }
+            }
+
+            /* both cases of every digit, in every position of a block */
+            for (auto token : {std::string("0123456789abcdefABCDEF0123456789abcdefABCDEF0123456789abcdefABCDEF"),
+                               std::string("aAbBcCdDeEfF00112233445566778899aAbBcCdDeEfF00112233445566778899")}) {
+                auto expected = decodeExpected(token, isBigEndian);
+                CHECK(decodesTo(kernel, token, isBigEndian, std::string::npos, &expected));
+            }
+
+            /* a bad character at every position is found there, and before any later one */
+            for (size_t size = 2; size <= MAX_TOKEN_SIZE; size += 2) {
+                auto token = makeToken(size);
+                for (size_t pos = 0; pos < size; pos++) {
+                    for (char badChar : BAD_CHARS) {
+                        auto badToken = token;
+                        badToken[pos] = badChar;
+                        CHECK(decodesTo(kernel, badToken, isBigEndian, pos, nullptr));
+                        if (pos + 1 < size) {
+                            badToken.back() = 'z';
+                            CHECK(decodesTo(kernel, badToken, isBigEndian, pos, nullptr));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /* the parser reports the column of the bad character in the line, counting from 1 */
+    for (size_t size : {2, 16, 30, 32, 34, 64, 98}) {
+        for (size_t pos : {size_t{0}, size / 2, size - 1}) {
+            auto token = makeToken(size);
+            token[pos] = 'g';
+            CHECK(getBadHexColumn("00001000 1F2003D5 " + token) == static_cast<int>(19 + pos));
+            CHECK(getBadHexColumn("00001000\t" + token + " C0035FD6") == static_cast<int>(10 + pos));
+        }
+    }
+    CHECK(getBadHexColumn("00001000 1F2003D") == 0);
+
+    /* @flag be reverses each token on its own, long ones through the kernel CPU picks */
+    for (size_t size : {8, 32, 64, 100}) {
+        auto token = makeToken(size);
+        auto expected = decodeExpected(token, false);
+        auto reversed = decodeExpected(token, true);
+        expected.insert(expected.end(), {0x1F, 0x20, 0x03, 0xD5});
+        reversed.insert(reversed.end(), {0xD5, 0x03, 0x20, 0x1F});
+        CHECK(parseValue("", "00001000 " + token + " 1F2003D5") == expected);
+        CHECK(parseValue("@flag be\n", "00001000 " + token + " 1F2003D5") == reversed);
+    }
+
+    return checkResult("hex_test");
+}
@@ -0,0 +1,300 @@
+/*
+ * Writes IPS files for small collections and applies them with a minimal IPS reader, checking that every byte ends up
+ * where the contents put it. Covers RLE records around the point where they start to pay off, records split at the
+ * size limit, empty values and contents at the offsets that read as the IPS and IPS32 footers.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <vector>
+#include "../pchtxt/pchtxt.hpp"
+#include "check.hpp"
+
+constexpr uint32_t IPS_FOOTER_OFFSET = 0x454F46;
+constexpr uint32_t IPS32_FOOTER_OFFSET = 0x45454F46;
+constexpr size_t MAX_RECORD_SIZE = 0xFFFF;
+
+using Bytes = std::vector<uint8_t>;
+using Image = std::map<uint64_t, uint8_t>; /* the patched bytes of a binary by offset */
+
+struct Content {
+    uint32_t offset;
+    Bytes value;
+};
+
+/* An enabled BIN patch for each content, in order. */
+pchtxt::PatchCollection makeCollection(std::initializer_list<Content> contents) {
+    pchtxt::PatchCollection collection;
+    collection.buildId = "0123456789ABCDEF0123456789ABCDEF";
+    for (auto &content : contents) {
+        auto &patch = collection.patches.emplace_back();
+        patch.type = pchtxt::BIN;
+        patch.enabled = true;
+        auto &patchContent = patch.contents.emplace_back();
+        patchContent.offset = content.offset;
+        patchContent.value.assign(content.value.begin(), content.value.end());
+    }
+    return collection;
+}
+
+Bytes repeat(uint8_t byte, size_t count) { return Bytes(count, byte); }
+
+/* count bytes that never repeat one after another. */
+Bytes literal(size_t count, uint8_t first = 1) {
+    Bytes result(count);
+    for (size_t i = 0; i < count; i++) result[i] = static_cast<uint8_t>(first + i % 2);
+    return result;
+}
+
+Bytes concat(std::initializer_list<Bytes> parts) {
+    Bytes result;
+    for (auto &part : parts) result.insert(result.end(), part.begin(), part.end());
+    return result;
+}
+
+/* What applying the contents in order does, later contents overwriting earlier ones. */
+Image expectedImage(const pchtxt::PatchCollection &collection) {
+    Image image;
+    for (auto &patch : collection.patches) {
+        for (auto &patchContent : patch.contents) {
+            for (size_t i = 0; i < patchContent.value.size(); i++) {
+                image[uint64_t{patchContent.offset} + i] = patchContent.value[i];
+            }
+        }
+    }
+    return image;
+}
+
+struct Record {
+    uint32_t offset;
+    size_t size;
+    bool isRun;
+};
+
+struct AppliedIps {
+    Image image;
+    std::vector<Record> records;
+};
+
+uint32_t readBigEndian(const Bytes &ips, size_t pos, int byteCount) {
+    uint32_t value = 0;
+    for (int i = 0; i < byteCount; i++) value = value << 8 | ips[pos + i];
+    return value;
+}
+
+/* Applies an IPS or IPS32 file the way a patcher reads it, or nothing if the file is malformed. */
+std::optional<AppliedIps> applyIps(const Bytes &ips) {
+    auto startsWith = [&](size_t pos, const char *magic) {
+        return ips.size() >= pos + std::strlen(magic) && std::memcmp(ips.data() + pos, magic, std::strlen(magic)) == 0;
+    };
+    int offsetSize;
+    const char *footer;
+    size_t pos;
+    if (startsWith(0, "IPS32")) {
+        offsetSize = 4;
+        footer = "EEOF";
+        pos = 5;
+    } else if (startsWith(0, "PATCH")) {
+        offsetSize = 3;
+        footer = "EOF";
+        pos = 5;
+    } else {
+        return std::nullopt;
+    }
+
+    AppliedIps result;
+    while (!startsWith(pos, footer)) {
+        if (pos + offsetSize + 2 > ips.size()) return std::nullopt;
+        auto offset = readBigEndian(ips, pos, offsetSize);
+        auto size = readBigEndian(ips, pos + offsetSize, 2);
+        pos += offsetSize + 2;
+        if (size == 0) {
+            if (pos + 3 > ips.size()) return std::nullopt;
+            auto runSize = readBigEndian(ips, pos, 2);
+            for (size_t i = 0; i < runSize; i++) result.image[uint64_t{offset} + i] = ips[pos + 2];
+            result.records.push_back({offset, runSize, true});
+            pos += 3;
+        } else {
+            if (pos + size > ips.size()) return std::nullopt;
+            for (size_t i = 0; i < size; i++) result.image[uint64_t{offset} + i] = ips[pos + i];
+            result.records.push_back({offset, size, false});
+            pos += size;
+        }
+    }
+    if (pos + std::strlen(footer) != ips.size()) return std::nullopt;
+    return result;
+}
+
+size_t countRuns(const AppliedIps &applied) {
+    size_t count = 0;
+    for (auto &record : applied.records) count += record.isRun;
+    return count;
+}
+
+/* The IPS file written by IpsStreamWriter, empty if it could not be written. */
+Bytes streamIps(const pchtxt::PatchCollection &collection) {
+    std::ostringstream ips;
+    pchtxt::IpsStreamWriter writer(ips);
+    for (auto &patch : collection.patches) {
+        for (auto &patchContent : patch.contents) writer.addContent(patchContent.offset, patchContent.value);
+    }
+    if (!writer.finish()) return {};
+    auto ipsStr = ips.str();
+    return Bytes(ipsStr.begin(), ipsStr.end());
+}
+
+/*
+ * Writes the IPS file, checks that it applies to exactly the expected bytes, and returns it applied. With the default
+ * options, the stream writer has to write the same file.
+ */
+std::optional<AppliedIps> roundTrip(const pchtxt::PatchCollection &collection, const pchtxt::IpsOptions &options) {
+    auto ips = pchtxt::getIps(collection, options);
+    CHECK(ips.size() == pchtxt::getIpsSize(collection, options));
+    if (options.format == pchtxt::IPS32 && !options.optimize && options.rleMinRunSize == 0) {
+        CHECK(streamIps(collection) == ips);
+    }
+    auto applied = applyIps(ips);
+    CHECK(applied.has_value());
+    if (!applied) return std::nullopt;
+    CHECK(applied->image == expectedImage(collection));
+    for (auto &record : applied->records) CHECK(record.size > 0 && record.size <= MAX_RECORD_SIZE);
+    return applied;
+}
+
+pchtxt::IpsOptions rleOptions(size_t minRunSize, pchtxt::IpsFormat format = pchtxt::IPS32) {
+    pchtxt::IpsOptions options;
+    options.format = format;
+    options.rleMinRunSize = minRunSize;
+    return options;
+}
+
+void testRleBreakEven() {
+    /* a run that is a whole value replaces a 6 byte header and its bytes with a 9 byte run record */
+    for (size_t runSize : {3, 4}) {
+        auto applied = roundTrip(makeCollection({{0x100, repeat(0xAA, runSize)}}), rleOptions(1));
+        if (applied) CHECK(countRuns(*applied) == (runSize > 3 ? 1u : 0u));
+    }
+
+    /* a run inside a value also needs a header for each literal it splits off */
+    for (size_t runSize : {15, 16}) {
+        auto value = concat({literal(8), repeat(0xAA, runSize), literal(8)});
+        auto collection = makeCollection({{0x100, value}});
+        auto applied = roundTrip(collection, rleOptions(1));
+        if (applied) CHECK(countRuns(*applied) == (runSize > 15 ? 1u : 0u));
+        CHECK(pchtxt::getIpsSize(collection, rleOptions(1)) <= pchtxt::getIpsSize(collection, {}));
+    }
+}
+
+void testRleThreshold() {
+    /* past the break even point, runs are only written from the threshold on */
+    auto collection = makeCollection({{0x100, concat({literal(8), repeat(0xAA, 32), literal(8)})}});
+    for (size_t minRunSize : {31, 32, 33}) {
+        auto applied = roundTrip(collection, rleOptions(minRunSize));
+        if (applied) CHECK(countRuns(*applied) == (minRunSize <= 32 ? 1u : 0u));
+    }
+
+    /* 0 writes no runs at all */
+    auto applied = roundTrip(makeCollection({{0x100, repeat(0xAA, 1000)}}), rleOptions(0));
+    if (applied) CHECK(countRuns(*applied) == 0);
+}
+
+void testRecordSizeLimit() {
+    /* values and runs over the limit are split into consecutive records */
+    for (size_t valueSize : {MAX_RECORD_SIZE, MAX_RECORD_SIZE + 1, 3 * MAX_RECORD_SIZE + 7}) {
+        auto applied = roundTrip(makeCollection({{0x1000, literal(valueSize)}}), {});
+        if (applied) CHECK(applied->records.size() == (valueSize + MAX_RECORD_SIZE - 1) / MAX_RECORD_SIZE);
+
+        /* a piece left over too short to pay off as a run stays literal */
+        applied = roundTrip(makeCollection({{0x1000, repeat(0, valueSize)}}), rleOptions(1));
+        if (applied) CHECK(applied->records.size() == (valueSize + MAX_RECORD_SIZE - 1) / MAX_RECORD_SIZE);
+        if (applied) CHECK(countRuns(*applied) >= valueSize / MAX_RECORD_SIZE);
+    }
+
+    /* the same with the contents sorted and merged */
+    auto options = rleOptions(16);
+    options.optimize = true;
+    roundTrip(makeCollection({{0x1000, literal(MAX_RECORD_SIZE)},
+                              {0x1000 + MAX_RECORD_SIZE, concat({repeat(7, 70000), literal(10)})},
+                              {0x1800, literal(20, 3)}}),
+              options);
+}
+
+void testEmptyValues() {
+    /* an empty value writes no record, as a record of size 0 would read as a run */
+    auto collection = makeCollection({{0x100, {}}, {0x200, literal(4)}, {0x300, {}}});
+    auto applied = roundTrip(collection, {});
+    if (applied) CHECK(applied->records.size() == 1);
+
+    auto options = rleOptions(1);
+    options.optimize = true;
+    roundTrip(collection, options);
+
+    auto emptyIps = pchtxt::getIps(makeCollection({{0x100, {}}}));
+    CHECK(emptyIps == concat({Bytes{'I', 'P', 'S', '3', '2'}, Bytes{'E', 'E', 'O', 'F'}}));
+}
+
+void testFooterOffsets() {
+    /* a content at a footer offset is written from a byte earlier, when the content before it ends there */
+    roundTrip(makeCollection({{IPS_FOOTER_OFFSET - 4, literal(4)}, {IPS_FOOTER_OFFSET, literal(4, 5)}}),
+              rleOptions(0, pchtxt::IPS));
+    roundTrip(makeCollection({{IPS32_FOOTER_OFFSET - 4, literal(4)}, {IPS32_FOOTER_OFFSET, literal(4, 5)}}), {});
+    roundTrip(makeCollection({{IPS32_FOOTER_OFFSET - MAX_RECORD_SIZE, literal(MAX_RECORD_SIZE)},
+                              {IPS32_FOOTER_OFFSET, literal(MAX_RECORD_SIZE, 5)}}),
+              {});
+
+    /* without one, it cannot be written in that format */
+    CHECK(pchtxt::getIps(makeCollection({{IPS32_FOOTER_OFFSET, literal(4)}})).empty());
+    CHECK(streamIps(makeCollection({{IPS32_FOOTER_OFFSET, literal(4)}})).empty());
+    CHECK(pchtxt::getIps(makeCollection({{IPS_FOOTER_OFFSET, literal(4)}}), rleOptions(0, pchtxt::IPS)).empty());
+
+    /* automatic format choice falls back to IPS32 when IPS cannot be written */
+    auto applied = roundTrip(makeCollection({{IPS_FOOTER_OFFSET, literal(4)}}), rleOptions(0, pchtxt::IPS_AUTO));
+    if (applied) CHECK(applied->records.front().offset == IPS_FOOTER_OFFSET);
+
+    /* runs never start or end at a footer offset, in either format */
+    for (auto format : {pchtxt::IPS, pchtxt::IPS32}) {
+        auto footerOffset = format == pchtxt::IPS ? IPS_FOOTER_OFFSET : IPS32_FOOTER_OFFSET;
+        auto options = rleOptions(1, format);
+        roundTrip(makeCollection({{footerOffset - 100, repeat(0, 200)}}), options);
+        roundTrip(makeCollection({{footerOffset - 100, concat({literal(100), repeat(0, 100)})}}), options);
+        roundTrip(makeCollection({{footerOffset - 100, concat({repeat(0, 100), literal(100)})}}), options);
+        auto runStart = footerOffset - uint32_t{MAX_RECORD_SIZE};
+        roundTrip(makeCollection({{runStart, repeat(0, 2 * MAX_RECORD_SIZE)}}), options);
+    }
+}
+
+void testLastOffset() {
+    /* a value can end at the last offset IPS32 addresses, but one running past it would wrap around to offset 0 */
+    auto lastOffset = uint64_t{0xFFFFFFFF};
+    roundTrip(makeCollection({{0xFFFFFFF0, literal(16)}}), {});
+    roundTrip(makeCollection({{0xFFFF0000, literal(0x10000)}}), {});
+    for (auto optimize : {false, true}) {
+        pchtxt::IpsOptions options;
+        options.optimize = optimize;
+        CHECK(pchtxt::getIps(makeCollection({{0xFFFFFFF0, literal(17)}}), options).empty());
+        CHECK(pchtxt::getIps(makeCollection({{0x100, literal(4)}, {0xFFFF0000, literal(0x20000)}}), options).empty());
+        CHECK(pchtxt::getIpsSize(makeCollection({{0xFFFF0000, literal(0x20000)}}), options) == 0);
+    }
+
+    /* the same for the stream writer */
+    for (size_t valueSize : {size_t{16}, size_t{17}}) {
+        std::ostringstream ips;
+        pchtxt::IpsStreamWriter writer(ips);
+        writer.addContent(0xFFFFFFF0, literal(valueSize));
+        CHECK(writer.finish() == (0xFFFFFFF0 + valueSize - 1 <= lastOffset));
+    }
+}
+
+int main() {
+    testRleBreakEven();
+    testRleThreshold();
+    testRecordSizeLimit();
+    testEmptyValues();
+    testFooterOffsets();
+    testLastOffset();
+    return checkResult("ips_test");
+}
@@ -0,0 +1,103 @@
+/*
+ * Parses a Patch Text large enough to be split into chunks on several threads, and checks that the output and logs
+ * are the same as one pass, with memory resources that are not thread safe as well as with the default one.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../pchtxt/pchtxt.hpp"
+#include "check.hpp"
+
+static size_t lastChunkCount = 0;
+
+/* Runs every index on a thread of its own. */
+void parallelFor(size_t count, const std::function<void(size_t)> &func) {
+    lastChunkCount = count;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < count; i++) threads.emplace_back(func, i);
+    for (auto &thread : threads) thread.join();
+}
+
+/*
+ * Several chunks' worth of collections, with build ids that start again later, one of them by a legacy rename, and an
+ * offset shift carried across.
+ */
+std::string makePchtxt() {
+    std::string pchtxt = "@title Parallel\n@program 0100000000010000\n\n@flag offset_shift 0x100\n";
+    for (int section = 0; section < 24; section++) {
+        pchtxt += "@flag nsobid " + std::string(31, '0') + std::to_string(section % 5) + "\n\n";
+        for (int i = 0; i < 2000; i++) {
+            pchtxt += "// Patch " + std::to_string(section) + "." + std::to_string(i) + " with a long name\n";
+            pchtxt += "@enabled\n" + std::to_string(10000000 + i * 16) + " 1F2003D5 C0035FD6 00112233\n\n";
+        }
+    }
+    /* a legacy build id renaming the last collection to one seen before, which merges the two */
+    pchtxt += "// Legacy\n@enabled\n00001000 1F2003D5\n@nsobid " + std::string(31, '0') + "0\n";
+    return pchtxt;
+}
+
+bool isSameOutput(const pchtxt::PatchTextOutput &lhs, const pchtxt::PatchTextOutput &rhs) {
+    if (lhs.meta.title != rhs.meta.title || lhs.meta.programId != rhs.meta.programId) return false;
+    if (lhs.collections.size() != rhs.collections.size()) return false;
+    auto rhsCollection = rhs.collections.begin();
+    for (auto &lhsCollection : lhs.collections) {
+        if (lhsCollection.buildId != rhsCollection->buildId || lhsCollection.targetType != rhsCollection->targetType ||
+            lhsCollection.patches.size() != rhsCollection->patches.size()) {
+            return false;
+        }
+        auto rhsPatch = rhsCollection->patches.begin();
+        for (auto &lhsPatch : lhsCollection.patches) {
+            if (lhsPatch.name != rhsPatch->name || lhsPatch.lineNum != rhsPatch->lineNum ||
+                lhsPatch.contents.size() != rhsPatch->contents.size()) {
+                return false;
+            }
+            auto rhsContent = rhsPatch->contents.begin();
+            for (auto &lhsContent : lhsPatch.contents) {
+                if (lhsContent.offset != rhsContent->offset ||
+                    !std::equal(lhsContent.value.begin(), lhsContent.value.end(), rhsContent->value.begin(),
+                                rhsContent->value.end())) {
+                    return false;
+                }
+                ++rhsContent;
+            }
+            ++rhsPatch;
+        }
+        ++rhsCollection;
+    }
+    return true;
+}
+
+int main() {
+    auto pchtxt = makePchtxt();
+    auto input = std::span<const char>(pchtxt);
+    std::ostringstream expectedLog;
+    auto expected = pchtxt::parsePchtxt(input, expectedLog);
+    CHECK(expected.collections.size() == 4);
+
+    std::pmr::monotonic_buffer_resource monotonicResource;
+    std::pmr::unsynchronized_pool_resource poolResource;
+    pchtxt::Arena arena;
+    for (auto *memoryResource : std::initializer_list<std::pmr::memory_resource *>{
+             std::pmr::new_delete_resource(), &monotonicResource, &poolResource, &arena}) {
+        std::ostringstream log;
+        auto out = pchtxt::parsePchtxt(input, log, parallelFor, memoryResource);
+        CHECK(lastChunkCount > 4);
+        CHECK(isSameOutput(out, expected));
+        CHECK(log.str() == expectedLog.str());
+        /* nothing in the output may point into the chunks' memory, which is gone by now */
+        bool isAllocatedFromResource = out.get_allocator().resource() == memoryResource;
+        for (auto &collection : out.collections) {
+            for (auto &patch : collection.patches) {
+                isAllocatedFromResource &= patch.get_allocator().resource() == memoryResource;
+            }
+        }
+        CHECK(isAllocatedFromResource);
+    }
+
+    return checkResult("parallel_test");
+}
@@ -0,0 +1,47 @@
+/*
+ * Checks that a SmallVector grows from its inline storage onto its memory resource, and that sizes past the 32 bits
+ * it keeps them in are refused instead of wrapping around.
+ */
+
+#include <cstdint>
+#include <memory_resource>
+#include <stdexcept>
+#include "../pchtxt/small_vector.hpp"
+#include "check.hpp"
+
+/* If func throws std::length_error. */
+template <typename Func>
+bool throwsLengthError(Func &&func) {
+    try {
+        func();
+    } catch (const std::length_error &) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    std::pmr::monotonic_buffer_resource resource;
+    pchtxt::SmallVector<uint8_t, 8> vector(&resource);
+    for (int i = 0; i < 8; i++) vector.push_back(i);
+    CHECK(vector.isInline());
+    vector.push_back(8);
+    CHECK(!vector.isInline());
+    CHECK(vector.size() == 9);
+    CHECK(vector.capacity() == 16);
+    CHECK(vector[0] == 0 && vector[8] == 8);
+
+    vector.resize(100);
+    CHECK(vector.size() == 100);
+    CHECK(vector[8] == 8 && vector[99] == 0);
+
+    /* 4 GiB and more would have been kept as its low 32 bits, a buffer far smaller than what is written to it */
+    auto oversize = size_t{UINT32_MAX} + 1;
+    CHECK(vector.max_size() == UINT32_MAX);
+    CHECK(throwsLengthError([&] { vector.reserve(oversize); }));
+    CHECK(throwsLengthError([&] { vector.resize(oversize + 16); }));
+    CHECK(vector.size() == 100);
+    CHECK(vector.capacity() < oversize);
+
+    return checkResult("small_vector_test");
+}